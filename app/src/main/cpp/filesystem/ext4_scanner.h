@@ -2,9 +2,17 @@
 #define EXT4_SCANNER_H
 
 #include "../include/native_scanner.h"
+#include "../utils/block_device.h"
+#include "../utils/extent_list.h"
+#include "../utils/inode_name_index.h"
+#include "../recovery/signature_detector.h"
 #include <string>
 #include <vector>
+#include <memory>
 #include <functional>
+#include <unordered_map>
+
+class AsyncReader;
 
 class Ext4Scanner {
 public:
@@ -15,23 +23,134 @@ public:
     std::vector<RecoveredFileInfo> scanDeletedFiles(const std::string& partition,
                                                    const std::vector<int>& fileTypes,
                                                    std::function<bool(const ScanProgress&)> progressCallback);
+    // Byte ranges of the blocks the block bitmaps mark free, in device order
+    bool getFreeExtents(const std::string& partition, std::vector<FileExtent>& extents);
+    // Signatures used to type deleted files from their first block
+    void setDatabase(std::shared_ptr<const SignatureDatabase> database);
 
 private:
+    // Compares the parsed metadata with the filesystem's own tools in host builds
+    friend class Ext4ScannerTest;
+    
     bool m_isRooted;
+    BlockDevice m_device;
+    std::shared_ptr<const SignatureDatabase> m_database;
+    SignatureDetector m_detector;
+    
+    struct GroupDescriptor {
+        uint64_t blockBitmap;
+        uint64_t inodeBitmap;
+        uint64_t inodeTable;
+        uint32_t freeInodes;
+        uint32_t itableUnused; // inodes at the end of the table that were never used
+        uint16_t flags;
+    };
     
+    // Filesystem geometry from the superblock
+    uint32_t m_blockSize;
+    uint64_t m_blocksCount;
+    uint32_t m_blocksPerGroup;
+    uint32_t m_firstDataBlock;
+    uint32_t m_descSize;
+    uint32_t m_inodesCount;
+    uint32_t m_featureCompat;
+    uint32_t m_featureIncompat;
+    uint32_t m_featureRoCompat;
+    uint32_t m_inodesPerGroup;
+    uint32_t m_inodeSize;
+    uint32_t m_reservedGdtBlocks;
+    uint32_t m_groupsPerFlex; // 1 without flex_bg
+    uint32_t m_journalInode;
+    std::vector<GroupDescriptor> m_groups;
+    
+    // The fields of an on-disk inode the scanner uses
     struct Ext4Inode {
-        uint32_t mode;
-        uint32_t size;
+        uint32_t number;
+        uint16_t mode;
+        uint16_t linksCount;
+        uint64_t size;
         uint32_t atime;
+        uint32_t ctime;
         uint32_t mtime;
         uint32_t dtime; // Deletion time
-        uint32_t blocks[15];
+        uint32_t flags;
+        uint32_t generation;
+        uint32_t blocks[15]; // i_block: extent tree root or block map
+        std::vector<FileExtent> extents; // content on the device, in file order, clipped to size
+        bool extentsComplete; // false if the surviving extents leave part of the file unmapped
     };
     
     bool readSuperblock(const std::string& device);
-    std::vector<Ext4Inode> scanInodeTable(const std::string& device);
-    RecoveredFileInfo inodeToFileInfo(const Ext4Inode& inode, uint32_t inodeNumber);
-    bool isInodeDeleted(const Ext4Inode& inode);
+    bool readGroupDescriptors();
+    bool readBlockBitmaps(ExtentList& list);
+    bool groupHasSuperblock(uint64_t group) const;
+    void buildUninitBitmap(uint64_t group, std::vector<uint8_t>& bitmap) const;
+    // One read planned by scanInodeTables: a run of inode bitmaps covering groups
+    // [first, end), or a run of table blocks holding freeSlots[first, end)
+    struct InodeRead {
+        uint64_t block;
+        uint32_t blockCount;
+        size_t first;
+        size_t end;
+    };
+    
+    // Per-thread buffers for scanInodeTables
+    struct InodeScanBuffers {
+        std::vector<uint8_t> blocks;
+        std::vector<uint32_t> freeSlots; // inode indices the inode bitmaps mark free
+        std::vector<InodeRead> reads;    // planned bitmap or table reads, in device order
+        std::vector<std::vector<uint8_t>> treeBlocks; // one extent tree node per level
+    };
+    
+    // A mapping from the extent tree, in filesystem blocks
+    struct BlockExtent {
+        uint32_t logical;
+        uint64_t physical;
+        uint32_t length;
+    };
+    
+    // Table slots that may hold inodes; 0 for groups whose table was never initialised
+    uint32_t usedInodeSlots(uint64_t group) const;
+    // Appends the deleted inodes of groups [firstGroup, endGroup) using a few large reads
+    // streamed through the worker's reader; safe to call from several threads at once
+    bool scanInodeTables(uint64_t firstGroup, uint64_t endGroup, AsyncReader& reader, InodeScanBuffers& buffers,
+                         std::vector<Ext4Inode>& deleted) const;
+    static void parseInode(const uint8_t* raw, uint32_t number, Ext4Inode& inode);
+    // Resolves the extent tree rooted in i_block into inode.extents
+    void decodeExtents(Ext4Inode& inode, InodeScanBuffers& buffers) const;
+    bool walkExtentNode(const uint8_t* node, size_t nodeSize, uint32_t level, InodeScanBuffers& buffers,
+                        std::vector<BlockExtent>& mapped) const;
+    // Copies of filesystem blocks found in the jbd2 journal
+    struct JournalCopy {
+        uint64_t offset;   // device byte offset of the copy
+        uint32_t sequence; // transaction that logged it
+        uint32_t older;    // index of the next older copy of the same block, or kNoCopy
+        bool escaped;      // the copy's first word was the journal magic and is stored cleared
+    };
+    
+    struct JournalIndex {
+        static constexpr uint32_t kNoCopy = 0xFFFFFFFF;
+        std::unordered_map<uint64_t, uint32_t> newest; // filesystem block -> newest copy
+        std::vector<JournalCopy> copies;
+    };
+    
+    bool readInode(uint32_t number, InodeScanBuffers& buffers, Ext4Inode& inode) const;
+    // Walks every descriptor block in the journal once and indexes the blocks it logged
+    bool buildJournalIndex(InodeScanBuffers& buffers, JournalIndex& index) const;
+    // Replaces a deleted inode's block map with the newest journaled copy that still had one
+    bool resolveFromJournal(const JournalIndex& index, InodeScanBuffers& buffers, Ext4Inode& inode) const;
+    // Walks the directory tree from the root, indexing the live subdirectories and the
+    // entries for candidates that deletion left in rec_len slack. Since Linux 5.14 deleting
+    // an entry wipes it, so slack names mostly come from devices on older kernels; encrypted
+    // directories are skipped because their names are ciphertext.
+    void indexDirectoryNames(const std::vector<Ext4Inode>& candidates, InodeNameIndex& names) const;
+    void indexDirectoryBlock(const uint8_t* block, uint32_t directory, const std::vector<uint32_t>& candidates,
+                             InodeNameIndex& names, std::vector<uint32_t>& subdirectories) const;
+    // Types candidates from the leading bytes of their first extent; 0 where nothing matches
+    void detectFileTypes(const std::vector<Ext4Inode>& inodes, std::vector<int>& types);
+    RecoveredFileInfo inodeToFileInfo(const Ext4Inode& inode, uint32_t inodeNumber, int fileType,
+                                      const std::string& partition, const InodeNameIndex& names);
+    static bool isInodeDeleted(const Ext4Inode& inode);
 };
 
 #endif // EXT4_SCANNER_H
\ No newline at end of file
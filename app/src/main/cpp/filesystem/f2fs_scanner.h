@@ -2,9 +2,15 @@
 #define F2FS_SCANNER_H
 
 #include "../include/native_scanner.h"
+#include "../utils/block_device.h"
+#include "../utils/extent_list.h"
+#include "../utils/inode_name_index.h"
+#include "../recovery/signature_detector.h"
 #include <string>
 #include <vector>
+#include <memory>
 #include <functional>
+#include <unordered_map>
 
 class F2fsScanner {
 public:
@@ -15,25 +21,138 @@ public:
     std::vector<RecoveredFileInfo> scanDeletedFiles(const std::string& partition,
                                                    const std::vector<int>& fileTypes,
                                                    std::function<bool(const ScanProgress&)> progressCallback);
+    // Byte ranges of main-area blocks the SIT valid maps mark free, in device order
+    bool getFreeExtents(const std::string& partition, std::vector<FileExtent>& extents);
+    // Signatures used to type deleted files from their first block
+    void setDatabase(std::shared_ptr<const SignatureDatabase> database);
 
 private:
+    // Compares the parsed metadata with the filesystem's own tools in host builds
+    friend class F2fsScannerTest;
+    
     bool m_isRooted;
+    BlockDevice m_device;
+    std::shared_ptr<const SignatureDatabase> m_database;
+    SignatureDetector m_detector;
+    
+    // Filesystem geometry from the superblock
+    uint32_t m_blockSize;
+    uint32_t m_blocksPerSegment;
+    uint32_t m_segmentCountSit;
+    uint32_t m_segmentCountNat;
+    uint32_t m_segmentCountMain;
+    uint32_t m_checkpointAddress;
+    uint32_t m_sitAddress;
+    uint32_t m_natAddress;
+    uint32_t m_mainAddress;
+    uint32_t m_checkpointPayload;
+    uint32_t m_rootIno;
+    uint32_t m_nodeIno;
+    uint32_t m_metaIno;
+    uint32_t m_features;
+    
+    // State of the newest valid checkpoint pack
+    uint64_t m_checkpointVersion;
+    uint32_t m_checkpointFlags;
+    uint32_t m_currentNodeSegments[3]; // hot, warm and cold node logs
+    uint16_t m_currentNodeOffsets[3]; // next block each node log writes
+    std::vector<uint8_t> m_sitBitmap; // set bit: the second SIT copy holds that block
+    std::vector<uint8_t> m_natBitmap; // set bit: the second NAT copy holds that block
+    // Entries the checkpoint keeps in its summary journals instead of the NAT and SIT areas
+    std::vector<uint8_t> m_natJournal;
+    std::vector<uint8_t> m_sitJournal;
+    
+    // Per main-area segment, from the SIT
+    struct SegmentEntry {
+        uint16_t validBlocks;
+        uint8_t type; // 0-2 hot/warm/cold data, 3-5 hot/warm/cold node
+        uint8_t validMap[64]; // bit per block, most significant bit first
+        uint64_t mtime;
+    };
+    std::vector<SegmentEntry> m_segments;
+    
+    // Per node id, from the NAT
+    struct NatEntry {
+        uint32_t ino;
+        uint32_t blockAddress; // 0: free nid
+    };
+    std::vector<NatEntry> m_nat;
     
+    // An obsolete inode block of a file whose node id the NAT has released
     struct F2fsNode {
-        uint32_t nid;
         uint32_t ino;
-        uint32_t flag;
+        uint32_t blockAddress; // where this copy of the inode was found
+        uint64_t cpVersion; // checkpoint the block was written under; newer copies win
+        uint16_t mode;
+        uint8_t inlineFlags;
+        uint32_t links;
         uint64_t size;
-        uint32_t blocks;
         uint64_t atime;
         uint64_t mtime;
         uint64_t ctime;
+        uint32_t parentIno;
+        std::string name;
+        uint32_t nids[5]; // direct, direct, indirect, indirect, double indirect node ids
+        uint32_t inodeBlocks; // file blocks the inode's own pointers can map
+        uint32_t inlineOffset; // start of the inline data or dentry area in the block
+        uint32_t inlineBytes;  // its capacity
+        std::vector<uint8_t> inlineData; // content of inline files, copied from the scanned block
+        uint32_t mappedBlocks; // leading file blocks mapped so far
+        std::vector<FileExtent> extents; // content on the device, in file order
+        bool extentsComplete;
+        bool dataReused; // some content block is valid again, so holds other data now
+    };
+    
+    // Where an obsolete direct or indirect node block of a deleted file was found
+    struct ObsoleteNode {
+        uint32_t blockAddress;
+        uint32_t ino;
+        uint64_t cpVersion;
     };
     
     bool readCheckpoint(const std::string& device);
-    std::vector<F2fsNode> scanNodeArea(const std::string& device);
-    RecoveredFileInfo nodeToFileInfo(const F2fsNode& node);
-    bool isNodeDeleted(const F2fsNode& node);
+    bool readSuperblock();
+    bool readJournals(uint64_t pack, uint32_t packBlocks);
+    // Load the current SIT and NAT into memory, with the checkpoint journals applied
+    bool readSit();
+    bool readNat();
+    static void parseSitEntry(const uint8_t* raw, SegmentEntry& entry);
+    // Node-type segments holding blocks the SIT marks invalid, with the block range to read
+    struct SegmentRange {
+        uint32_t segment;
+        uint32_t firstBlock;
+        uint32_t blockCount;
+    };
+    std::vector<SegmentRange> planNodeSegments() const;
+    bool isBlockValid(uint32_t blockAddress) const;
+    // What one worker has found so far, with its own read buffer
+    struct NodeScanState {
+        std::vector<uint8_t> buffer;
+        std::vector<F2fsNode> inodes;
+        std::unordered_map<uint32_t, size_t> inodeIndex; // ino -> position in inodes
+        std::unordered_map<uint32_t, ObsoleteNode> nodes;
+        // Names of deleted files and directories, from deleted directory inodes and from
+        // the inline dentries of any obsolete directory copy
+        std::vector<std::pair<std::pair<uint32_t, uint32_t>, std::string>> names; // {ino, parent}, name
+    };
+    static void keepNewestInode(NodeScanState& state, F2fsNode&& inode);
+    static void keepNewestNode(NodeScanState& state, uint32_t nid, const ObsoleteNode& node);
+    // Decodes the invalid blocks of a segment range read into data; safe to call from
+    // several threads at once with different states
+    void scanNodeSegment(const SegmentRange& range, const uint8_t* data, NodeScanState& state) const;
+    bool parseInodeBlock(const uint8_t* block, uint32_t blockAddress, F2fsNode& node) const;
+    void harvestInlineDentries(const uint8_t* block, const F2fsNode& directory, NodeScanState& state) const;
+    // Maps the file blocks behind the inode's node ids, from the obsolete nodes found
+    void mapNodeBlocks(F2fsNode& node, const std::unordered_map<uint32_t, ObsoleteNode>& nodes,
+                       std::vector<uint8_t>& scratch) const;
+    bool appendBlock(F2fsNode& node, uint32_t blockAddress) const;
+    // Resolves a directory's path below the root through the NAT, or through the recovered
+    // names for deleted directories; false if the chain of parents is broken
+    bool parentPath(uint32_t ino, const InodeNameIndex& names, std::unordered_map<uint32_t, std::string>& cache,
+                    std::vector<uint8_t>& scratch, std::string& path) const;
+    void detectFileTypes(const std::vector<F2fsNode>& nodes, std::vector<int>& types);
+    RecoveredFileInfo nodeToFileInfo(const F2fsNode& node, int fileType, const std::string& partition,
+                                     const std::string& path);
 };
 
 #endif // F2FS_SCANNER_H
\ No newline at end of file
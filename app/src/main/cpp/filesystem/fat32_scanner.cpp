@@ -1,5 +1,8 @@
 #include "fat32_scanner.h"
 #include "../utils/root_utils.h"
+#include "../utils/byte_order.h"
+#include "../utils/async_reader.h"
+#include "../utils/extension_classifier.h"
 #include <android/log.h>
 #include <fstream>
 #include <cstring>
@@ -10,7 +13,14 @@
 #define LOGI(...) __android_log_print(ANDROID_LOG_INFO, LOG_TAG, __VA_ARGS__)
 #define LOGE(...) __android_log_print(ANDROID_LOG_ERROR, LOG_TAG, __VA_ARGS__)
 
-Fat32Scanner::Fat32Scanner() : m_isRooted(false) {}
+// The FAT is streamed in large reads; entries are 28-bit cluster numbers
+static constexpr size_t kFatChunkSize = 1024 * 1024;
+static constexpr size_t kFatQueueDepth = 4;
+static constexpr uint32_t kFatEntryMask = 0x0FFFFFFF;
+
+Fat32Scanner::Fat32Scanner()
+    : m_isRooted(false), m_bytesPerSector(0), m_sectorsPerCluster(0), m_fatOffset(0),
+      m_fatLength(0), m_dataOffset(0), m_clusterCount(0) {}
 
 Fat32Scanner::~Fat32Scanner() = default;
 
@@ -35,6 +45,7 @@ std::vector<RecoveredFileInfo> Fat32Scanner::scanDeletedFiles(const std::string&
     // Read boot sector to get FAT32 information
     if (!readBootSector(partition)) {
         LOGE("Failed to read FAT32 boot sector");
+        m_device.close();
         return results;
     }
     
@@ -64,6 +75,8 @@ std::vector<RecoveredFileInfo> Fat32Scanner::scanDeletedFiles(const std::string&
         }
     }
     
+    m_device.close();
+    
     LOGI("FAT32 scan completed. Found %zu deleted files", results.size());
     return results;
 }
@@ -73,13 +86,104 @@ bool Fat32Scanner::readBootSector(const std::string& device) {
         return false;
     }
     
-    // Use root access to read raw device boot sector
-    std::string command = "dd if=" + device + " bs=512 count=1 2>/dev/null";
+    if (!m_device.isOpen() && !m_device.open(device)) {
+        return false;
+    }
     
-    // This is a simplified implementation
-    // In a real implementation, you would parse the actual FAT32 boot sector structure
     LOGI("Reading FAT32 boot sector from %s", device.c_str());
     
+    // Parse the boot sector in place (zero-copy on mapped images)
+    std::vector<uint8_t> scratch;
+    const uint8_t* boot = m_device.view(0, 512, scratch);
+    if (!boot) {
+        LOGE("Device too small for a FAT32 boot sector");
+        return false;
+    }
+    
+    if (boot[510] != 0x55 || boot[511] != 0xAA) {
+        LOGE("Missing FAT32 boot sector signature");
+        return false;
+    }
+    
+    uint16_t bytesPerSector = readLe16(boot + 11);
+    uint8_t sectorsPerCluster = boot[13];
+    if (bytesPerSector == 0 || sectorsPerCluster == 0) {
+        LOGE("Invalid FAT32 BPB");
+        return false;
+    }
+    
+    uint16_t reservedSectors = readLe16(boot + 14);
+    uint8_t fatCount = boot[16];
+    uint32_t totalSectors = readLe16(boot + 19) != 0 ? readLe16(boot + 19) : readLe32(boot + 32);
+    uint32_t fatSectors = readLe32(boot + 36);
+    if (readLe16(boot + 22) != 0 || fatSectors == 0 || fatCount == 0) {
+        LOGE("Not a FAT32 volume (FAT12/16 layout)");
+        return false;
+    }
+    
+    uint64_t dataSector = reservedSectors + (uint64_t)fatCount * fatSectors;
+    if (dataSector >= totalSectors) {
+        LOGE("Invalid FAT32 layout");
+        return false;
+    }
+    
+    m_bytesPerSector = bytesPerSector;
+    m_sectorsPerCluster = sectorsPerCluster;
+    m_fatOffset = (uint64_t)reservedSectors * bytesPerSector;
+    m_fatLength = (uint64_t)fatSectors * bytesPerSector;
+    m_dataOffset = dataSector * bytesPerSector;
+    // The FAT may have room for more entries than the data area has clusters
+    m_clusterCount = (uint32_t)std::min<uint64_t>((totalSectors - dataSector) / sectorsPerCluster,
+                                                  m_fatLength / 4 - 2);
+    
+    LOGI("FAT32: %u bytes per sector, %u sectors per cluster, %u clusters", bytesPerSector,
+         sectorsPerCluster, m_clusterCount);
+    
+    return true;
+}
+
+bool Fat32Scanner::getFreeExtents(const std::string& partition, std::vector<FileExtent>& extents) {
+    if (!readBootSector(partition)) {
+        m_device.close();
+        return false;
+    }
+    
+    ExtentList list;
+    bool ok = readFreeClusters(list);
+    m_device.close();
+    if (!ok) {
+        return false;
+    }
+    
+    LOGI("FAT32: %llu free bytes in %zu extents", (unsigned long long)list.totalLength(),
+         list.extents().size());
+    extents = list.release();
+    return true;
+}
+
+bool Fat32Scanner::readFreeClusters(ExtentList& list) {
+    const uint64_t clusterSize = (uint64_t)m_bytesPerSector * m_sectorsPerCluster;
+    // Entries 0 and 1 are reserved; cluster 2 is the first data cluster
+    const uint64_t fatBytes = ((uint64_t)m_clusterCount + 2) * 4;
+    
+    AsyncReader reader(m_device, kFatQueueDepth, kFatChunkSize);
+    reader.start(AsyncReader::splitRange(m_fatOffset, fatBytes, kFatChunkSize));
+    
+    uint64_t cluster = 0;
+    AsyncReader::Block block;
+    while (reader.next(block)) {
+        if (!block.complete) {
+            LOGE("Failed to read the FAT at offset %llu", (unsigned long long)block.offset);
+            return false;
+        }
+        
+        for (size_t i = 0; i + 4 <= block.length; i += 4, ++cluster) {
+            if (cluster >= 2 && (readLe32(block.data + i) & kFatEntryMask) == 0) {
+                list.addRun(m_dataOffset + (cluster - 2) * clusterSize, clusterSize);
+            }
+        }
+    }
+    
     return true;
 }
 
@@ -144,21 +248,12 @@ RecoveredFileInfo Fat32Scanner::entryToFileInfo(const Fat32DirectoryEntry& entry
     info.isDeleted = true;
     info.isRecoverable = true;
     
-    // Determine file type based on extension
-    std::string ext = info.name.substr(info.name.find_last_of('.') + 1);
-    std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
-    
-    if (ext == "jpg" || ext == "jpeg" || ext == "png" || ext == "gif") {
-        info.fileType = 1; // PHOTO
-    } else if (ext == "mp4" || ext == "avi" || ext == "mov") {
-        info.fileType = 2; // VIDEO
-    } else if (ext == "txt" || ext == "doc" || ext == "pdf") {
-        info.fileType = 3; // DOCUMENT
-    } else if (ext == "mp3" || ext == "wav" || ext == "aac") {
-        info.fileType = 4; // AUDIO
-    } else {
-        info.fileType = 0; // OTHER
+    // Determine file type from the space-padded 8.3 extension
+    size_t extLength = 0;
+    while (extLength < sizeof(entry.ext) && entry.ext[extLength] != ' ') {
+        ++extLength;
     }
+    info.fileType = ExtensionClassifier::classify(entry.ext, extLength);
     
     // Calculate confidence based on file size and cluster availability
     if (entry.size > 0 && entry.firstCluster > 0) {
@@ -2,6 +2,8 @@
 #define FAT32_SCANNER_H
 
 #include "../include/native_scanner.h"
+#include "../utils/block_device.h"
+#include "../utils/extent_list.h"
 #include <string>
 #include <vector>
 #include <functional>
@@ -15,9 +17,20 @@ public:
     std::vector<RecoveredFileInfo> scanDeletedFiles(const std::string& partition,
                                                    const std::vector<int>& fileTypes,
                                                    std::function<bool(const ScanProgress&)> progressCallback);
+    // Byte ranges of the clusters the FAT marks free, in device order
+    bool getFreeExtents(const std::string& partition, std::vector<FileExtent>& extents);
 
 private:
     bool m_isRooted;
+    BlockDevice m_device;
+    
+    // Volume geometry from the BPB
+    uint32_t m_bytesPerSector;
+    uint32_t m_sectorsPerCluster;
+    uint64_t m_fatOffset;     // byte offset of the first FAT
+    uint64_t m_fatLength;     // bytes per FAT
+    uint64_t m_dataOffset;    // byte offset of cluster 2
+    uint32_t m_clusterCount;
     
     struct Fat32DirectoryEntry {
         char name[8];       // 8-character filename
@@ -36,6 +49,7 @@ private:
     };
     
     bool readBootSector(const std::string& device);
+    bool readFreeClusters(ExtentList& list);
     std::vector<Fat32DirectoryEntry> scanDirectoryEntries(const std::string& device);
     RecoveredFileInfo entryToFileInfo(const Fat32DirectoryEntry& entry);
     bool isEntryDeleted(const Fat32DirectoryEntry& entry);
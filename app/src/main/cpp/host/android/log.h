@@ -0,0 +1,34 @@
+#ifndef DATARESCUE_HOST_ANDROID_LOG_H
+#define DATARESCUE_HOST_ANDROID_LOG_H
+
+// Stands in for the NDK's <android/log.h> in host builds; messages go to stderr
+#include <cstdarg>
+#include <cstdio>
+
+enum android_LogPriority {
+    ANDROID_LOG_UNKNOWN = 0,
+    ANDROID_LOG_DEFAULT,
+    ANDROID_LOG_VERBOSE,
+    ANDROID_LOG_DEBUG,
+    ANDROID_LOG_INFO,
+    ANDROID_LOG_WARN,
+    ANDROID_LOG_ERROR,
+    ANDROID_LOG_FATAL,
+    ANDROID_LOG_SILENT,
+};
+
+inline int __android_log_print(int priority, const char* tag, const char* format, ...)
+    __attribute__((format(printf, 3, 4)));
+
+inline int __android_log_print(int priority, const char* tag, const char* format, ...) {
+    static const char kLevels[] = "??VDIWEF?";
+    va_list args;
+    va_start(args, format);
+    int written = std::fprintf(stderr, "%c/%s: ", kLevels[priority & 7], tag);
+    written += std::vfprintf(stderr, format, args);
+    va_end(args);
+    std::fputc('\n', stderr);
+    return written + 1;
+}
+
+#endif // DATARESCUE_HOST_ANDROID_LOG_H
@@ -1,10 +1,17 @@
 #ifndef NATIVE_SCANNER_H
 #define NATIVE_SCANNER_H
 
-#include <jni.h>
 #include <string>
 #include <vector>
 #include <memory>
+#include <mutex>
+#include <unordered_map>
+
+// A run of file content on the raw device
+struct FileExtent {
+    long long offset;
+    long long length;
+};
 
 struct RecoveredFileInfo {
     std::string name;
@@ -17,6 +24,9 @@ struct RecoveredFileInfo {
     int confidence;
     bool isDeleted;
     bool isRecoverable;
+    // Files that only exist as raw device blocks (carved or deleted) are read from here
+    std::string sourceDevice;
+    std::vector<FileExtent> extents;
 };
 
 struct ScanProgress {
@@ -31,6 +41,7 @@ struct ScanProgress {
 class FileSystemScanner;
 class FileCarver;
 class SignatureDetector;
+class SignatureDatabase;
 
 class NativeScanner {
 public:
@@ -44,6 +55,10 @@ public:
     std::vector<RecoveredFileInfo> startQuickScan(const std::vector<int>& fileTypes,
                                                   bool (*progressCallback)(const ScanProgress&));
     bool recoverFile(const RecoveredFileInfo& fileInfo, const std::string& outputPath);
+    // Replaces the built-in signatures for detection and carving; the compiled matcher is
+    // cached in cacheDir when one is given. The current database is kept on failure, and
+    // while a scan is running, since the scanners hold pointers into it.
+    bool loadSignatureDatabase(const std::string& databasePath, const std::string& cacheDir);
     void stopScan();
     bool isRootAvailable();
     std::vector<std::string> getAvailablePartitions();
@@ -51,9 +66,13 @@ public:
 private:
     bool m_isRooted;
     bool m_shouldStop;
+    std::mutex m_scanMutex; // held for the length of a scan
     std::unique_ptr<FileSystemScanner> m_fsScanner;
     std::unique_ptr<FileCarver> m_fileCarver;
     std::unique_ptr<SignatureDetector> m_signatureDetector;
+    std::shared_ptr<const SignatureDatabase> m_signatureDatabase;
+    // Device locations of the last deep scan's results, by path, for recoverFile()
+    std::unordered_map<std::string, RecoveredFileInfo> m_deviceFiles;
     
     // Private helper methods
     std::vector<RecoveredFileInfo> scanAccessibleAreas(const std::vector<int>& fileTypes,
@@ -62,10 +81,11 @@ private:
                                                const std::vector<int>& fileTypes,
                                                int maxDepth,
                                                int currentDepth = 0);
-    RecoveredFileInfo analyzeFile(const std::string& path, const struct stat& fileStat);
+    RecoveredFileInfo analyzeFile(const std::string& path, const struct stat& fileStat, int fileType);
     int calculateConfidence(const std::string& path, const struct stat& fileStat);
     bool isFileRecoverable(const std::string& path, const struct stat& fileStat);
     bool shouldIncludeFile(const RecoveredFileInfo& fileInfo, const std::vector<int>& fileTypes);
+    bool recoverFromDevice(const RecoveredFileInfo& fileInfo, const std::string& outputPath);
 };
 
 #endif // NATIVE_SCANNER_H
\ No newline at end of file
@@ -287,6 +287,33 @@ Java_com_datarescue_pro_data_native_NativeFileScanner_recoverFile(JNIEnv *env, j
     return result;
 }
 
+JNIEXPORT jboolean JNICALL
+Java_com_datarescue_pro_data_native_NativeFileScanner_loadSignatureDatabase(JNIEnv *env, jobject,
+                                                                            jstring databasePath,
+                                                                            jstring cacheDir) {
+    if (!g_scanner) {
+        LOGE("Scanner not initialized");
+        return false;
+    }
+    
+    const char* databaseStr = env->GetStringUTFChars(databasePath, nullptr);
+    const char* cacheStr = env->GetStringUTFChars(cacheDir, nullptr);
+    
+    if (!databaseStr || !cacheStr) {
+        if (databaseStr) env->ReleaseStringUTFChars(databasePath, databaseStr);
+        if (cacheStr) env->ReleaseStringUTFChars(cacheDir, cacheStr);
+        LOGE("Failed to get path strings");
+        return false;
+    }
+    
+    bool result = g_scanner->loadSignatureDatabase(databaseStr, cacheStr);
+    
+    env->ReleaseStringUTFChars(databasePath, databaseStr);
+    env->ReleaseStringUTFChars(cacheDir, cacheStr);
+    
+    return result;
+}
+
 JNIEXPORT void JNICALL
 Java_com_datarescue_pro_data_native_NativeFileScanner_stopScan(JNIEnv *, jobject) {
     if (g_scanner) {
@@ -4,8 +4,11 @@
 #include "filesystem/fat32_scanner.h"
 #include "recovery/file_carver.h"
 #include "recovery/signature_detector.h"
+#include "recovery/signature_database.h"
 #include "utils/root_utils.h"
 #include "utils/disk_utils.h"
+#include "utils/block_device.h"
+#include "utils/async_reader.h"
 #include <android/log.h>
 #include <unistd.h>
 #include <sys/stat.h>
@@ -21,6 +24,10 @@
 #define LOGI(...) __android_log_print(ANDROID_LOG_INFO, LOG_TAG, __VA_ARGS__)
 #define LOGE(...) __android_log_print(ANDROID_LOG_ERROR, LOG_TAG, __VA_ARGS__)
 
+// Device-backed recovery reads ahead this many chunks of file content
+static constexpr size_t kRecoverChunkSize = 1024 * 1024;
+static constexpr size_t kRecoverQueueDepth = 4;
+
 // Forward declarations for filesystem scanner interface
 class FileSystemScanner {
 public:
@@ -31,6 +38,10 @@ public:
         const std::vector<int>& fileTypes,
         std::function<bool(const ScanProgress&)> progressCallback
     ) = 0;
+    // Unallocated byte ranges of the partition; false if the allocation maps are unreadable
+    virtual bool getFreeExtents(const std::string& partition, std::vector<FileExtent>& extents) = 0;
+    // Scanners that type files from their content use the shared signature database
+    virtual void setDatabase(std::shared_ptr<const SignatureDatabase>) {}
 };
 
 // Wrapper classes for filesystem scanners
@@ -51,6 +62,14 @@ public:
     ) override {
         return scanner->scanDeletedFiles(partition, fileTypes, progressCallback);
     }
+    
+    bool getFreeExtents(const std::string& partition, std::vector<FileExtent>& extents) override {
+        return scanner->getFreeExtents(partition, extents);
+    }
+    
+    void setDatabase(std::shared_ptr<const SignatureDatabase> database) override {
+        scanner->setDatabase(std::move(database));
+    }
 };
 
 class F2fsScannerWrapper : public FileSystemScanner {
@@ -70,6 +89,14 @@ public:
     ) override {
         return scanner->scanDeletedFiles(partition, fileTypes, progressCallback);
     }
+    
+    bool getFreeExtents(const std::string& partition, std::vector<FileExtent>& extents) override {
+        return scanner->getFreeExtents(partition, extents);
+    }
+    
+    void setDatabase(std::shared_ptr<const SignatureDatabase> database) override {
+        scanner->setDatabase(std::move(database));
+    }
 };
 
 class Fat32ScannerWrapper : public FileSystemScanner {
@@ -89,11 +116,16 @@ public:
     ) override {
         return scanner->scanDeletedFiles(partition, fileTypes, progressCallback);
     }
+    
+    bool getFreeExtents(const std::string& partition, std::vector<FileExtent>& extents) override {
+        return scanner->getFreeExtents(partition, extents);
+    }
 };
 
 NativeScanner::NativeScanner() : m_isRooted(false), m_shouldStop(false) {
     m_signatureDetector = std::make_unique<SignatureDetector>();
     m_fileCarver = std::make_unique<FileCarver>();
+    m_signatureDatabase = SignatureDatabase::builtin();
 }
 
 NativeScanner::~NativeScanner() = default;
@@ -122,6 +154,7 @@ bool NativeScanner::initialize(bool isRooted) {
     } else {
         m_fsScanner = std::make_unique<Fat32ScannerWrapper>();
     }
+    m_fsScanner->setDatabase(m_signatureDatabase);
 
     return m_fsScanner->initialize(m_isRooted);
 }
@@ -129,6 +162,7 @@ bool NativeScanner::initialize(bool isRooted) {
 std::vector<RecoveredFileInfo> NativeScanner::startDeepScan(const std::string& partition,
                                                            const std::vector<int>& fileTypes,
                                                            bool (*progressCallback)(const ScanProgress&)) {
+    std::lock_guard<std::mutex> scanning(m_scanMutex);
     std::vector<RecoveredFileInfo> results;
     m_shouldStop = false;
     
@@ -145,15 +179,33 @@ std::vector<RecoveredFileInfo> NativeScanner::startDeepScan(const std::string& p
             return !m_shouldStop;
         });
         
-        // Add file carving results
-        auto carvedFiles = m_fileCarver->carveFiles(partition, fileTypes, [&](const ScanProgress& progress) {
+        auto carveProgress = [&](const ScanProgress& progress) {
             if (progressCallback) {
                 return progressCallback(progress) && !m_shouldStop;
             }
             return !m_shouldStop;
-        });
+        };
+        
+        // Add file carving results. Allocated blocks hold live files, so only free space is
+        // carved when the filesystem's allocation maps can be read.
+        std::vector<FileExtent> freeExtents;
+        std::vector<RecoveredFileInfo> carvedFiles;
+        if (m_fsScanner->getFreeExtents(partition, freeExtents)) {
+            carvedFiles = m_fileCarver->carveFiles(partition, fileTypes, freeExtents, carveProgress);
+        } else {
+            LOGI("Allocation maps unavailable, carving the whole partition");
+            carvedFiles = m_fileCarver->carveFiles(partition, fileTypes, carveProgress);
+        }
         
         results.insert(results.end(), carvedFiles.begin(), carvedFiles.end());
+        
+        // Remember where device-only files live; recovery requests only carry the path
+        m_deviceFiles.clear();
+        for (const auto& file : results) {
+            if (!file.extents.empty()) {
+                m_deviceFiles[file.path] = file;
+            }
+        }
     } else {
         // Non-root mode: Scan accessible areas
         results = scanAccessibleAreas(fileTypes, progressCallback);
@@ -169,6 +221,7 @@ std::vector<RecoveredFileInfo> NativeScanner::startDeepScan(const std::string& p
 
 std::vector<RecoveredFileInfo> NativeScanner::startQuickScan(const std::vector<int>& fileTypes,
                                                             bool (*progressCallback)(const ScanProgress&)) {
+    std::lock_guard<std::mutex> scanning(m_scanMutex);
     std::vector<RecoveredFileInfo> results;
     m_shouldStop = false;
     
@@ -252,35 +305,59 @@ std::vector<RecoveredFileInfo> NativeScanner::scanDirectory(const std::string& p
         return results;
     }
     
+    // Entries are stat'ed and their headers read relative to the open directory, and all
+    // regular files of the directory are typed in one batch before recursing
+    int dirFd = dirfd(dir);
+    std::vector<std::string> fileNames;
+    std::vector<struct stat> fileStats;
+    std::vector<std::string> subdirectories;
+    
     struct dirent* entry;
     while ((entry = readdir(dir)) != nullptr && !m_shouldStop) {
         if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) {
             continue;
         }
         
-        std::string fullPath = path + "/" + entry->d_name;
         struct stat fileStat;
         
-        if (stat(fullPath.c_str(), &fileStat) == 0) {
+        if (fstatat(dirFd, entry->d_name, &fileStat, 0) == 0) {
             if (S_ISREG(fileStat.st_mode)) {
-                // Regular file
-                RecoveredFileInfo fileInfo = analyzeFile(fullPath, fileStat);
-                if (shouldIncludeFile(fileInfo, fileTypes)) {
-                    results.push_back(fileInfo);
-                }
+                fileNames.push_back(entry->d_name);
+                fileStats.push_back(fileStat);
             } else if (S_ISDIR(fileStat.st_mode)) {
-                // Directory - recurse
-                auto subResults = scanDirectory(fullPath, fileTypes, maxDepth, currentDepth + 1);
-                results.insert(results.end(), subResults.begin(), subResults.end());
+                subdirectories.push_back(entry->d_name);
             }
         }
     }
     
+    std::vector<int> detectedTypes;
+    if (!m_shouldStop) {
+        m_signatureDetector->detectFileTypes(dirFd, fileNames, detectedTypes);
+    }
     closedir(dir);
+    
+    for (size_t i = 0; i < detectedTypes.size(); ++i) {
+        // Regular file
+        RecoveredFileInfo fileInfo = analyzeFile(path + "/" + fileNames[i], fileStats[i], detectedTypes[i]);
+        if (shouldIncludeFile(fileInfo, fileTypes)) {
+            results.push_back(fileInfo);
+        }
+    }
+    
+    for (const auto& name : subdirectories) {
+        if (m_shouldStop) {
+            break;
+        }
+        // Directory - recurse
+        auto subResults = scanDirectory(path + "/" + name, fileTypes, maxDepth, currentDepth + 1);
+        results.insert(results.end(), subResults.begin(), subResults.end());
+    }
+    
     return results;
 }
 
-RecoveredFileInfo NativeScanner::analyzeFile(const std::string& path, const struct stat& fileStat) {
+RecoveredFileInfo NativeScanner::analyzeFile(const std::string& path, const struct stat& fileStat,
+                                             int fileType) {
     RecoveredFileInfo info;
     info.path = path;
     info.originalPath = path;
@@ -290,8 +367,8 @@ RecoveredFileInfo NativeScanner::analyzeFile(const std::string& path, const stru
     info.dateDeleted = 0;
     info.isDeleted = false;
     
-    // Determine file type from extension and signature
-    info.fileType = m_signatureDetector->detectFileType(path);
+    // Determined from signature and extension by the caller's batch detection
+    info.fileType = fileType;
     
     // Calculate confidence based on various factors
     info.confidence = calculateConfidence(path, fileStat);
@@ -379,6 +456,14 @@ bool NativeScanner::shouldIncludeFile(const RecoveredFileInfo& fileInfo, const s
 bool NativeScanner::recoverFile(const RecoveredFileInfo& fileInfo, const std::string& outputPath) {
     LOGI("Recovering file: %s to %s", fileInfo.path.c_str(), outputPath.c_str());
     
+    if (!fileInfo.extents.empty()) {
+        return recoverFromDevice(fileInfo, outputPath);
+    }
+    auto deviceFile = m_deviceFiles.find(fileInfo.path);
+    if (deviceFile != m_deviceFiles.end()) {
+        return recoverFromDevice(deviceFile->second, outputPath);
+    }
+    
     std::ifstream source(fileInfo.path, std::ios::binary);
     if (!source.is_open()) {
         LOGE("Failed to open source file: %s", fileInfo.path.c_str());
@@ -407,6 +492,77 @@ bool NativeScanner::recoverFile(const RecoveredFileInfo& fileInfo, const std::st
     return success;
 }
 
+bool NativeScanner::recoverFromDevice(const RecoveredFileInfo& fileInfo, const std::string& outputPath) {
+    BlockDevice device;
+    if (!device.open(fileInfo.sourceDevice)) {
+        LOGE("Failed to open source device: %s", fileInfo.sourceDevice.c_str());
+        return false;
+    }
+    
+    std::ofstream dest(outputPath, std::ios::binary);
+    if (!dest.is_open()) {
+        LOGE("Failed to create destination file: %s", outputPath.c_str());
+        return false;
+    }
+    
+    // Fragments are written back to back in extent order. Scattered extents are queued
+    // together so the reads of later fragments overlap with writing the current one.
+    std::vector<AsyncReader::Request> requests;
+    for (const auto& extent : fileInfo.extents) {
+        auto chunks = AsyncReader::splitRange((uint64_t)extent.offset, (uint64_t)extent.length, kRecoverChunkSize);
+        requests.insert(requests.end(), chunks.begin(), chunks.end());
+    }
+    
+    AsyncReader reader(device, kRecoverQueueDepth, kRecoverChunkSize);
+    reader.start(std::move(requests));
+    
+    AsyncReader::Block block;
+    while (reader.next(block)) {
+        if (!block.complete) {
+            LOGE("Short read of %zu bytes at %llu from %s", block.length,
+                 (unsigned long long)block.offset, fileInfo.sourceDevice.c_str());
+            return false;
+        }
+        dest.write(reinterpret_cast<const char*>(block.data), block.length);
+    }
+    
+    bool success = dest.good();
+    dest.close();
+    
+    if (success) {
+        LOGI("Successfully recovered file: %s (%zu extents)", fileInfo.name.c_str(), fileInfo.extents.size());
+    } else {
+        LOGE("Failed to recover file: %s", fileInfo.name.c_str());
+    }
+    
+    return success;
+}
+
+bool NativeScanner::loadSignatureDatabase(const std::string& databasePath, const std::string& cacheDir) {
+    // A running scan holds record pointers into the current database and reads it unlocked
+    std::unique_lock<std::mutex> scanning(m_scanMutex, std::try_to_lock);
+    if (!scanning.owns_lock()) {
+        LOGE("Keeping current signatures; cannot replace them during a scan");
+        return false;
+    }
+    
+    auto database = std::make_shared<SignatureDatabase>();
+    if (!database->parseFile(databasePath)) {
+        LOGE("Keeping current signatures; cannot load %s", databasePath.c_str());
+        return false;
+    }
+    database->compile(cacheDir);
+    
+    m_signatureDatabase = database;
+    m_signatureDetector->setDatabase(database);
+    m_fileCarver->setDatabase(database);
+    if (m_fsScanner) {
+        m_fsScanner->setDatabase(database);
+    }
+    LOGI("Loaded %zu signatures from %s", database->records().size(), databasePath.c_str());
+    return true;
+}
+
 void NativeScanner::stopScan() {
     m_shouldStop = true;
     LOGI("Scan stop requested");
@@ -1,7 +1,14 @@
 #include "file_carver.h"
+#include "../utils/thread_pool.h"
+#include "../utils/async_reader.h"
 #include <android/log.h>
 #include <fstream>
 #include <algorithm>
+#include <atomic>
+#include <memory>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
 #include <ctime>
 
 #define LOG_TAG "FileCarver"
@@ -9,56 +16,33 @@
 #define LOGE(...) __android_log_print(ANDROID_LOG_ERROR, LOG_TAG, __VA_ARGS__)
 
 FileCarver::FileCarver() {
-    initializeSignatures();
+    setDatabase(SignatureDatabase::builtin());
 }
 
 FileCarver::~FileCarver() = default;
 
-void FileCarver::initializeSignatures() {
-    // JPEG
-    m_signatures.push_back({
-        {0xFF, 0xD8, 0xFF}, // Header
-        {0xFF, 0xD9}, // Footer
-        "jpg",
-        1, // PHOTO
-        50 * 1024 * 1024 // 50MB max
-    });
-    
-    // PNG
-    m_signatures.push_back({
-        {0x89, 0x50, 0x4E, 0x47, 0x0D, 0x0A, 0x1A, 0x0A}, // Header
-        {0x49, 0x45, 0x4E, 0x44, 0xAE, 0x42, 0x60, 0x82}, // Footer
-        "png",
-        1, // PHOTO
-        20 * 1024 * 1024 // 20MB max
-    });
-    
-    // MP4
-    m_signatures.push_back({
-        {0x00, 0x00, 0x00, 0x18, 0x66, 0x74, 0x79, 0x70}, // Header (ftyp)
-        {}, // No specific footer
-        "mp4",
-        2, // VIDEO
-        500 * 1024 * 1024 // 500MB max
-    });
+void FileCarver::setDatabase(std::shared_ptr<const SignatureDatabase> database) {
+    m_database = std::move(database);
+    m_signatures.clear();
     
-    // MP3
-    m_signatures.push_back({
-        {0xFF, 0xFB}, // Header (MP3 frame sync)
-        {}, // No specific footer
-        "mp3",
-        4, // AUDIO
-        100 * 1024 * 1024 // 100MB max
-    });
-    
-    // PDF
-    m_signatures.push_back({
-        {0x25, 0x50, 0x44, 0x46}, // %PDF
-        {0x25, 0x25, 0x45, 0x4F, 0x46}, // %%EOF
-        "pdf",
-        3, // DOCUMENT
-        50 * 1024 * 1024 // 50MB max
-    });
+    for (const auto& record : m_database->records()) {
+        FileSignature signature = {&record, nullptr, nullptr};
+        if (record.walker == "jpeg") {
+            signature.walk = FormatWalker::walkJpeg;
+            signature.findGap = FormatWalker::findJpegGap; // Bridges a break inside the scan data
+        } else if (record.walker == "png") {
+            signature.walk = FormatWalker::walkPng;
+            signature.findGap = FormatWalker::findPngGap;
+        } else if (record.walker == "mp4") {
+            // Sample data has no structure to check a continuation against
+            signature.walk = FormatWalker::walkMp4;
+        } else if (record.walker == "pdf") {
+            signature.walk = FormatWalker::walkPdf;
+        } else if (!record.walker.empty()) {
+            LOGE("Unknown walker '%s' for %s; carving it by footer", record.walker.c_str(), record.name.c_str());
+        }
+        m_signatures.push_back(signature);
+    }
     
     LOGI("Initialized %zu file signatures", m_signatures.size());
 }
@@ -66,84 +50,607 @@ void FileCarver::initializeSignatures() {
 std::vector<RecoveredFileInfo> FileCarver::carveFiles(const std::string& partition,
                                                      const std::vector<int>& fileTypes,
                                                      std::function<bool(const ScanProgress&)> progressCallback) {
-    std::vector<RecoveredFileInfo> results;
-    
+    return carve(partition, fileTypes, nullptr, progressCallback);
+}
+
+std::vector<RecoveredFileInfo> FileCarver::carveFiles(const std::string& partition,
+                                                     const std::vector<int>& fileTypes,
+                                                     const std::vector<FileExtent>& ranges,
+                                                     std::function<bool(const ScanProgress&)> progressCallback) {
+    return carve(partition, fileTypes, &ranges, progressCallback);
+}
+
+std::vector<RecoveredFileInfo> FileCarver::carve(const std::string& partition,
+                                                 const std::vector<int>& fileTypes,
+                                                 const std::vector<FileExtent>* ranges,
+                                                 std::function<bool(const ScanProgress&)> progressCallback) {
     LOGI("Starting file carving on partition: %s", partition.c_str());
     
-    for (const auto& signature : m_signatures) {
+    // The database's automaton holds every header and footer, so the device is read once
+    const SignatureDatabase& database = *m_database;
+    const PatternMatcher& matcher = database.matcher();
+    std::vector<CarveState> states;
+    std::vector<size_t> recordStates(m_signatures.size(), SIZE_MAX);
+    
+    for (size_t i = 0; i < m_signatures.size(); ++i) {
+        const FileSignature& signature = m_signatures[i];
         // Skip if file type not requested
         if (!fileTypes.empty() && 
-            std::find(fileTypes.begin(), fileTypes.end(), signature.fileType) == fileTypes.end()) {
+            std::find(fileTypes.begin(), fileTypes.end(), signature.record->fileType) == fileTypes.end()) {
             continue;
         }
         
-        auto carvedFiles = carveBySignature(partition, signature, progressCallback);
-        results.insert(results.end(), carvedFiles.begin(), carvedFiles.end());
+        recordStates[i] = states.size();
+        states.push_back({&signature, false, 0, 0, BlockClass::Structured, 0});
+    }
+    
+    if (states.empty()) {
+        return {};
+    }
+    
+    std::vector<PatternRole> roles(matcher.patternCount());
+    for (size_t id = 0; id < roles.size(); ++id) {
+        const SignatureDatabase::PatternRole& source = database.role((int)id);
+        const FileSignature& signature = m_signatures[source.record];
+        const SignatureRecord& record = *signature.record;
+        PatternRole& role = roles[id];
+        role.stateIndex = recordStates[source.record];
+        role.isFooter = source.isFooter;
+        // Walked formats find their own end, so their footers need not be matched
+        role.active = role.stateIndex != SIZE_MAX && !(source.isFooter && signature.walk);
+        role.startDistance = record.headerOffset + record.anchorOffset;
+        role.verify = record.anchorLength < record.header.size() ? &record : nullptr;
+    }
+    
+    auto carved = carveParallel(partition, ranges, states, matcher, roles, progressCallback);
+    
+    std::vector<RecoveredFileInfo> results;
+    results.reserve(carved.size());
+    for (const auto& file : carved) {
+        RecoveredFileInfo info = createCarvedFileInfo(partition, file);
+        info.name = "carved_" + std::to_string(file.offset) + "." + file.signature->record->extension;
+        info.confidence = file.confidence;
+        results.push_back(info);
     }
     
     LOGI("File carving completed. Carved %zu files", results.size());
     return results;
 }
 
-std::vector<RecoveredFileInfo> FileCarver::carveBySignature(const std::string& device,
-                                                           const FileSignature& signature,
-                                                           std::function<bool(const ScanProgress&)> progressCallback) {
-    std::vector<RecoveredFileInfo> results;
+std::vector<FileCarver::CarvedFile> FileCarver::carveParallel(const std::string& device,
+                                                             const std::vector<FileExtent>* ranges,
+                                                             std::vector<CarveState>& states,
+                                                             const PatternMatcher& matcher,
+                                                             const std::vector<PatternRole>& roles,
+                                                             std::function<bool(const ScanProgress&)> progressCallback) {
+    std::vector<CarvedFile> carved;
+    
+    BlockDevice dev;
+    if (!dev.open(device)) {
+        LOGE("Cannot carve %s: device not readable", device.c_str());
+        return carved;
+    }
+    
+    const uint64_t deviceSize = dev.size();
+    if (deviceSize == 0) {
+        return carved;
+    }
+    
+    // Without a range list the whole device is carved
+    std::vector<FileExtent> scanRanges;
+    if (ranges) {
+        std::vector<FileExtent> sorted(*ranges);
+        std::sort(sorted.begin(), sorted.end(), [](const FileExtent& a, const FileExtent& b) {
+            return a.offset < b.offset;
+        });
+        for (const auto& range : sorted) {
+            uint64_t start = (uint64_t)range.offset;
+            uint64_t end = std::min<uint64_t>(deviceSize, start + (uint64_t)range.length);
+            if (start >= end) {
+                continue;
+            }
+            // Reading through a small allocated hole is cheaper than restarting the stream
+            if (!scanRanges.empty()) {
+                FileExtent& last = scanRanges.back();
+                uint64_t lastEnd = (uint64_t)(last.offset + last.length);
+                if (start <= lastEnd + kMinRangeGap) {
+                    last.length = (long long)(std::max(end, lastEnd) - (uint64_t)last.offset);
+                    continue;
+                }
+            }
+            scanRanges.push_back({(long long)start, (long long)(end - start)});
+        }
+    } else {
+        scanRanges.push_back({0, (long long)deviceSize});
+    }
+    
+    // Ranges are cut into shards; none crosses a range boundary
+    std::vector<Shard> shards;
+    uint64_t scanBytes = 0;
+    for (const auto& range : scanRanges) {
+        const uint64_t end = (uint64_t)(range.offset + range.length);
+        for (uint64_t start = (uint64_t)range.offset; start < end; start += kShardSize) {
+            shards.push_back({start, std::min(end, start + kShardSize)});
+        }
+        scanBytes += (uint64_t)range.length;
+        dev.adviseSequential((uint64_t)range.offset, (uint64_t)range.length);
+    }
+    if (shards.empty()) {
+        return carved;
+    }
+    
+    ThreadPool pool;
+    const size_t shardCount = shards.size();
+    
+    const size_t workerCount = std::min(pool.size(), shardCount);
+    
+    // One read-ahead pipeline per worker, reused for every shard it picks up
+    std::vector<std::unique_ptr<AsyncReader>> readers;
+    for (size_t i = 0; i < workerCount; ++i) {
+        readers.push_back(std::make_unique<AsyncReader>(dev, kReadQueueDepth, kChunkSize));
+    }
+    
+    std::vector<ShardResult> shardResults(shardCount);
+    std::atomic<uint64_t> bytesScanned(0);
+    std::atomic<bool> stopped(false);
+    ScanProgress progress = {0, 0, 0, "Carving files", 0};
+    
+    LOGI("Carving %llu of %llu bytes in %zu shards on %zu threads", (unsigned long long)scanBytes,
+         (unsigned long long)deviceSize, shardCount, workerCount);
+    
+    pool.parallelFor(shardCount, [&](size_t shard, size_t worker) {
+        scanShard(*readers[worker], matcher, roles, shards[shard].start, shards[shard].end,
+                  shardResults[shard],
+                  [&](size_t bytes) {
+            uint64_t total = bytesScanned.fetch_add(bytes) + bytes;
+            // Only the calling thread talks to the progress callback
+            if (worker == 0) {
+                progress.percentage = (int)(std::min(total, scanBytes) * 100 / scanBytes);
+                if (progressCallback && !progressCallback(progress)) {
+                    stopped = true;
+                }
+            }
+            return !stopped.load();
+        });
+    });
     
-    // This is a simplified implementation
-    // In a real file carver, you would:
-    // 1. Read the raw device in chunks
-    // 2. Search for file signatures
-    // 3. Extract complete files based on headers/footers
-    // 4. Validate file integrity
-    
-    // For demonstration, create some mock carved files
-    for (int i = 0; i < 10; ++i) {
-        RecoveredFileInfo info = createCarvedFileInfo(
-            device, 
-            i * 1024 * 1024, // Offset
-            (i + 1) * 512 * 1024, // Size
-            signature.fileType
-        );
+    if (stopped) {
+        return carved;
+    }
+    
+    // Shards partition anchor offsets, so concatenating them yields every match exactly
+    // once; headers anchored past the file start can still land in the previous shard
+    std::vector<MatchHit> hits;
+    std::vector<BlockRun> zeroRuns;
+    std::vector<BlockRun> skippedRuns;
+    uint64_t randomBytes = 0;
+    for (auto& shard : shardResults) {
+        hits.insert(hits.end(), shard.hits.begin(), shard.hits.end());
+        zeroRuns.insert(zeroRuns.end(), shard.zeroRuns.begin(), shard.zeroRuns.end());
+        skippedRuns.insert(skippedRuns.end(), shard.skippedRuns.begin(), shard.skippedRuns.end());
+        randomBytes += shard.randomBytes;
+        shard = ShardResult();
+    }
+    uint64_t zeroBytes = 0;
+    for (const auto& run : zeroRuns) {
+        zeroBytes += run.end - run.start;
+    }
+    LOGI("Passed over %llu zeroed and %llu high-entropy bytes", (unsigned long long)zeroBytes,
+         (unsigned long long)randomBytes);
+    std::stable_sort(hits.begin(), hits.end(), [&](const MatchHit& a, const MatchHit& b) {
+        if (a.position != b.position) {
+            return a.position < b.position;
+        }
+        return roles[a.patternId].stateIndex < roles[b.patternId].stateIndex;
+    });
+    
+    // Where several formats claim the same file start the earliest record wins, as in
+    // detection (e.g. HEIF over MP4, APK over ZIP)
+    size_t kept = 0;
+    for (size_t i = 0; i < hits.size(); ++i) {
+        if (!roles[hits[i].patternId].isFooter && kept > 0 &&
+            hits[kept - 1].position == hits[i].position && !roles[hits[kept - 1].patternId].isFooter) {
+            continue;
+        }
+        hits[kept++] = hits[i];
+    }
+    hits.resize(kept);
+    
+    // Walk the structure of every candidate whose format supports it, in parallel
+    std::vector<size_t> walkJobs;
+    for (size_t i = 0; i < hits.size(); ++i) {
+        const PatternRole& role = roles[hits[i].patternId];
+        if (!role.isFooter && states[role.stateIndex].signature->walk) {
+            walkJobs.push_back(i);
+        }
+    }
+    
+    std::vector<WalkJob> walks(walkJobs.size());
+    std::vector<std::unique_ptr<DeviceCursor>> cursors;
+    for (size_t i = 0; i < workerCount; ++i) {
+        cursors.push_back(std::make_unique<DeviceCursor>(dev));
+    }
+    
+    pool.parallelFor(walkJobs.size(), [&](size_t job, size_t worker) {
+        const MatchHit& hit = hits[walkJobs[job]];
+        const FileSignature& signature = *states[roles[hit.patternId].stateIndex].signature;
+        WalkJob& result = walks[job];
+        result.walk = signature.walk(*cursors[worker], hit.position, signature.record->maxSize);
+        result.bridged = false;
         
-        info.name = "carved_" + std::to_string(i) + "." + signature.extension;
-        info.confidence = 70 + (i % 20); // Varying confidence
+        // A long validated prefix that breaks off is most likely fragmented
+        if (!result.walk.complete && signature.findGap && result.walk.failure >= kMinPartialLength) {
+            result.bridged = signature.findGap(*cursors[worker], hit.position, signature.record->maxSize,
+                                               result.walk, result.gap);
+        }
+    });
+    
+    // Replay the matches through the carving state machines. Before each hit, open files
+    // get the chance to end at a footer in the skipped runs they have reached meanwhile.
+    std::vector<uint8_t> scratch;
+    auto closeAtSkippedFooters = [&](uint64_t until) {
+        uint64_t footer;
+        for (auto& state : states) {
+            if (findSkippedFooter(dev, skippedRuns, state, until, scratch, footer)) {
+                handleMatch(state, true, {footer, -1, BlockClass::Structured}, carved);
+            }
+        }
+    };
+    
+    size_t nextWalk = 0;
+    size_t range = 0;
+    for (size_t i = 0; i < hits.size(); ++i) {
+        const MatchHit& hit = hits[i];
+        const PatternRole& role = roles[hit.patternId];
+        CarveState& state = states[role.stateIndex];
         
-        results.push_back(info);
+        // Files bounded only by the next header cannot run on into allocated blocks
+        while (hit.position >= (uint64_t)(scanRanges[range].offset + scanRanges[range].length)) {
+            closeAtSkippedFooters((uint64_t)(scanRanges[range].offset + scanRanges[range].length));
+            closeAtRangeEnd(states, (uint64_t)(scanRanges[range].offset + scanRanges[range].length), carved);
+            ++range;
+        }
+        closeAtSkippedFooters(hit.position);
         
-        // Update progress
-        ScanProgress progress = {
-            (i * 100) / 10,
-            i,
-            10,
-            "Carving " + signature.extension + " files",
-            0
-        };
+        if (nextWalk < walkJobs.size() && walkJobs[nextWalk] == i) {
+            handleWalkedHeader(state, hit, walks[nextWalk++], carved);
+        } else {
+            handleMatch(state, role.isFooter, hit, carved);
+        }
+    }
+    
+    closeAtSkippedFooters((uint64_t)(scanRanges[range].offset + scanRanges[range].length));
+    closeAtRangeEnd(states, (uint64_t)(scanRanges[range].offset + scanRanges[range].length), carved);
+    
+    std::sort(carved.begin(), carved.end(), [](const CarvedFile& a, const CarvedFile& b) {
+        return a.offset < b.offset;
+    });
+    for (auto& file : carved) {
+        adjustConfidence(file, zeroRuns);
+    }
+    
+    return carved;
+}
+
+bool FileCarver::scanShard(AsyncReader& reader, const PatternMatcher& matcher,
+                           const std::vector<PatternRole>& roles,
+                           uint64_t shardStart, uint64_t shardEnd,
+                           ShardResult& result, const std::function<bool(size_t)>& onChunk) {
+    // Start early enough to see patterns that begin just before the shard (they are
+    // dropped below) and read far enough to complete patterns that begin inside it.
+    // Reads start on a block boundary so every chunk classifies whole blocks.
+    const uint64_t blockSize = BlockClassifier::kBlockSize;
+    const size_t overlap = matcher.maxPatternLength() > 0 ? matcher.maxPatternLength() - 1 : 0;
+    const uint64_t readStart = (shardStart > overlap ? shardStart - overlap : 0) / blockSize * blockSize;
+    const uint64_t readEnd = std::min(reader.device().size(), shardEnd + overlap);
+    
+    // Zero and random blocks are not run through the automaton. Files start there only on
+    // sector boundaries, so each sector start gets a window as long as the longest header
+    // reaches, and the first and last bytes of a noisy run are matched in full so patterns
+    // that straddle its edges are found. Footers inside the run are looked for during the
+    // replay, and only while a file that ends in one is open.
+    size_t headerReach = 0;
+    bool footersActive = false;
+    for (size_t id = 0; id < roles.size(); ++id) {
+        if (roles[id].active && roles[id].isFooter) {
+            footersActive = true;
+        } else if (roles[id].active) {
+            headerReach = std::max<size_t>(headerReach, roles[id].startDistance + matcher.patternLength((int)id));
+        }
+    }
+    
+    uint32_t matchState = PatternMatcher::initialState();
+    bool completed = true;
+    std::vector<MatchHit>& hits = result.hits;
+    result.randomBytes = 0;
+    
+    reader.start(AsyncReader::splitRange(readStart, readEnd - readStart, kChunkSize));
+    
+    AsyncReader::Block block;
+    BlockClass blockClass = BlockClass::Structured;    // block being scanned
+    BlockClass previousClass = BlockClass::Structured; // the block before it
+    uint64_t pieceStart = 0;
+    uint64_t noisyFrom = UINT64_MAX; // start of the run of zero or random blocks being scanned
+    bool skipping = false;           // the automaton stopped inside that run
+    std::vector<uint8_t> tail(overlap); // last bytes of the run, where the automaton rejoins
+    size_t tailLength = 0;
+    
+    auto onMatch = [&](int patternId, uint64_t position) {
+        const PatternRole& role = roles[patternId];
+        if (!role.active || position < shardStart || position >= shardEnd) {
+            return;
+        }
+        // Footers end compressed data, so they are kept wherever they turn up
+        if (role.isFooter) {
+            hits.push_back({position, patternId, blockClass});
+            return;
+        }
+        if (position < role.startDistance) {
+            return;
+        }
+        // Short anchors match by chance all over zeros and ciphertext, but a file that
+        // starts in such a block starts on a sector boundary. Headers that began in the
+        // structured block before it are unaffected.
+        const uint64_t fileStart = position - role.startDistance;
+        if (fileStart >= noisyFrom && fileStart % kSectorSize != 0) {
+            return;
+        }
+        const BlockClass startClass = fileStart >= pieceStart ? blockClass : previousClass;
+        if (!role.verify || headerMatches(reader.device(), block, *role.verify, fileStart)) {
+            hits.push_back({fileStart, patternId, startClass});
+        }
+    };
+    
+    while (reader.next(block)) {
+        const uint64_t chunkEnd = block.offset + block.length;
+        for (uint64_t position = block.offset; position < chunkEnd;) {
+            const uint64_t pieceEnd = std::min(chunkEnd, (position / blockSize + 1) * blockSize);
+            const uint8_t* piece = block.data + (position - block.offset);
+            const size_t length = (size_t)(pieceEnd - position);
+            previousClass = blockClass;
+            blockClass = BlockClassifier::classify(piece, length).type;
+            const bool noisy = blockClass == BlockClass::Zero || blockClass == BlockClass::Random;
+            pieceStart = position;
+            
+            if (!noisy) {
+                if (skipping) {
+                    // Restart at the end of the noisy run, as a pattern may begin in its last bytes
+                    matchState = PatternMatcher::initialState();
+                    matcher.scan(tail.data(), tailLength, position - tailLength, matchState, onMatch);
+                    skipping = false;
+                }
+                noisyFrom = UINT64_MAX;
+                matcher.scan(piece, length, position, matchState, onMatch);
+            } else {
+                if (noisyFrom == UINT64_MAX) {
+                    noisyFrom = position;
+                }
+                if (!skipping) {
+                    // Complete the patterns running into the noisy run from the block before
+                    matcher.scan(piece, std::min(length, overlap), position, matchState, onMatch);
+                    skipping = true;
+                }
+                for (uint64_t sector = position; sector < pieceEnd; sector += kSectorSize) {
+                    uint32_t sectorState = PatternMatcher::initialState();
+                    const size_t window = (size_t)std::min<uint64_t>(headerReach, chunkEnd - sector);
+                    matcher.scan(block.data + (sector - block.offset), window, sector, sectorState, onMatch);
+                }
+                tailLength = std::min(length, overlap);
+                memcpy(tail.data(), piece + length - tailLength, tailLength);
+            }
+            
+            if (noisy) {
+                const uint64_t start = std::max(position, shardStart);
+                const uint64_t end = std::min(pieceEnd, shardEnd);
+                if (start < end && footersActive) {
+                    if (!result.skippedRuns.empty() && result.skippedRuns.back().end == start) {
+                        result.skippedRuns.back().end = end;
+                    } else {
+                        result.skippedRuns.push_back({start, end});
+                    }
+                }
+                if (start < end) {
+                    if (blockClass == BlockClass::Random) {
+                        result.randomBytes += end - start;
+                    } else if (!result.zeroRuns.empty() && result.zeroRuns.back().end == start) {
+                        result.zeroRuns.back().end = end;
+                    } else {
+                        result.zeroRuns.push_back({start, end});
+                    }
+                }
+            }
+            position = pieceEnd;
+        }
+        
+        if (!block.complete) {
+            // Unreadable sectors: skip them and restart matching after the gap
+            LOGE("Short read at offset %llu", (unsigned long long)(block.offset + block.length));
+            matchState = PatternMatcher::initialState();
+            noisyFrom = UINT64_MAX;
+            skipping = false;
+        }
         
-        if (progressCallback && !progressCallback(progress)) {
+        if (!onChunk(block.length)) {
+            completed = false;
             break;
         }
     }
     
-    return results;
+    // The automaton reports in end order; replay needs start order
+    std::stable_sort(hits.begin(), hits.end(), [](const MatchHit& a, const MatchHit& b) {
+        return a.position < b.position;
+    });
+    return completed;
 }
 
-bool FileCarver::matchesSignature(const uint8_t* data, const std::vector<uint8_t>& signature) {
-    for (size_t i = 0; i < signature.size(); ++i) {
-        if (data[i] != signature[i]) {
-            return false;
+void FileCarver::adjustConfidence(CarvedFile& file, const std::vector<BlockRun>& zeroRuns) {
+    int confidence = file.confidence;
+    
+    // An unwalked header in a block that otherwise looks like noise is as likely to be
+    // a chance match as a file whose first block is compressed data
+    if (file.startClass == BlockClass::Random && !file.signature->walk) {
+        confidence -= 10;
+    }
+    
+    // Zeroed blocks inside a file mean trimmed or overwritten content
+    uint64_t zeroBytes;
+    if (file.gapLength == 0) {
+        zeroBytes = zeroBytesIn(zeroRuns, file.offset, file.offset + file.size);
+    } else {
+        const uint64_t resume = file.gapStart + file.gapLength;
+        zeroBytes = zeroBytesIn(zeroRuns, file.offset, file.gapStart) +
+                    zeroBytesIn(zeroRuns, resume, resume + file.size - (file.gapStart - file.offset));
+    }
+    if (file.size > 0) {
+        confidence -= (int)(40 * std::min(zeroBytes, file.size) / file.size);
+    }
+    
+    file.confidence = std::max(5, std::min(100, confidence));
+}
+
+uint64_t FileCarver::zeroBytesIn(const std::vector<BlockRun>& zeroRuns, uint64_t start, uint64_t end) {
+    auto run = std::upper_bound(zeroRuns.begin(), zeroRuns.end(), start, [](uint64_t offset, const BlockRun& r) {
+        return offset < r.end;
+    });
+    uint64_t total = 0;
+    for (; run != zeroRuns.end() && run->start < end; ++run) {
+        total += std::min(end, run->end) - std::max(start, run->start);
+    }
+    return total;
+}
+
+bool FileCarver::headerMatches(const BlockDevice& device, const AsyncReader::Block& block,
+                               const SignatureRecord& record, uint64_t fileStart) {
+    const uint64_t headerStart = fileStart + record.headerOffset;
+    const size_t length = record.header.size();
+    if (headerStart >= block.offset && headerStart + length <= block.offset + block.length) {
+        return SignatureDatabase::matchesHeader(record, block.data + (headerStart - block.offset), length);
+    }
+    // The header straddles a chunk edge; this is rare enough to read it separately
+    uint8_t header[SignatureDatabase::kMaxHeaderLength];
+    return device.read(headerStart, header, length) == (long long)length &&
+           SignatureDatabase::matchesHeader(record, header, length);
+}
+
+bool FileCarver::findSkippedFooter(const BlockDevice& device, const std::vector<BlockRun>& skippedRuns,
+                                   CarveState& state, uint64_t until, std::vector<uint8_t>& scratch,
+                                   uint64_t& footer) {
+    const SignatureRecord& record = *state.signature->record;
+    if (!state.open || record.footer.empty() || state.signature->walk) {
+        return false;
+    }
+    // A footer only counts after the header and within maxSize, as in handleMatch
+    const uint64_t from = std::max(state.footerSearchedTo, state.start + record.headerOffset + record.header.size());
+    until = std::min(until, state.start + record.maxSize);
+    if (from >= until) {
+        return false;
+    }
+    state.footerSearchedTo = until;
+    
+    auto run = std::upper_bound(skippedRuns.begin(), skippedRuns.end(), from,
+                                [](uint64_t position, const BlockRun& run) { return position < run.end; });
+    for (; run != skippedRuns.end() && run->start < until; ++run) {
+        const uint64_t end = std::min(run->end, until);
+        for (uint64_t position = std::max(run->start, from); position < end; position += kChunkSize) {
+            // Footers that start in the run may end just past it
+            const size_t span = (size_t)std::min<uint64_t>(end - position, kChunkSize);
+            const size_t length = (size_t)std::min<uint64_t>(span + record.footer.size() - 1, device.size() - position);
+            const uint8_t* data = device.view(position, length, scratch);
+            if (!data) {
+                break;
+            }
+            const void* found = memmem(data, length, record.footer.data(), record.footer.size());
+            if (found && (size_t)(static_cast<const uint8_t*>(found) - data) < span) {
+                footer = position + (uint64_t)(static_cast<const uint8_t*>(found) - data);
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+void FileCarver::handleMatch(CarveState& state, bool isFooter, const MatchHit& hit, std::vector<CarvedFile>& carved) {
+    const uint64_t position = hit.position;
+    const SignatureRecord& record = *state.signature->record;
+    
+    if (state.open && position - state.start >= record.maxSize) {
+        closeCandidate(state, record.maxSize, 50, carved);
+    }
+    
+    if (isFooter) {
+        if (state.open && position >= state.start + record.headerOffset + record.header.size()) {
+            uint64_t end = position + record.footer.size() + record.trailerLength;
+            closeCandidate(state, std::min<uint64_t>(end - state.start, record.maxSize), 85, carved);
+        }
+        return;
+    }
+    
+    if (state.open) {
+        if (!record.footer.empty()) {
+            return; // Embedded header (e.g. JPEG thumbnail) inside the current file
         }
+        // Without a footer the next header bounds the current file
+        closeCandidate(state, position - state.start, 70, carved);
     }
-    return true;
+    state.open = true;
+    state.start = position;
+    state.startClass = hit.startClass;
 }
 
-RecoveredFileInfo FileCarver::createCarvedFileInfo(const std::string& path, size_t offset, size_t size, int fileType) {
+void FileCarver::handleWalkedHeader(CarveState& state, const MatchHit& hit, const WalkJob& job,
+                                    std::vector<CarvedFile>& carved) {
+    const uint64_t position = hit.position;
+    // Headers inside an already carved file (e.g. EXIF thumbnails) belong to it
+    if (position < state.skipUntil) {
+        return;
+    }
+    
+    const WalkResult& walk = job.walk;
+    if (walk.complete) {
+        carved.push_back({state.signature, position, walk.length, 90, 0, 0, hit.startClass});
+        state.skipUntil = position + walk.length;
+    } else if (job.bridged) {
+        // Two fragments that walk end to end; the gap may hold other files
+        const GapResult& gap = job.gap;
+        carved.push_back({state.signature, position, gap.length, 80,
+                          gap.breakOffset, gap.resumeOffset - gap.breakOffset, hit.startClass});
+        state.skipUntil = gap.breakOffset;
+    } else if (walk.length >= kMinPartialLength) {
+        // Only a prefix validated: likely truncated or fragmented
+        carved.push_back({state.signature, position, walk.length, 40, 0, 0, hit.startClass});
+    }
+}
+
+void FileCarver::closeAtRangeEnd(std::vector<CarveState>& states, uint64_t rangeEnd,
+                                 std::vector<CarvedFile>& carved) {
+    for (auto& state : states) {
+        if (state.open) {
+            uint64_t size = std::min<uint64_t>(state.signature->record->maxSize, rangeEnd - state.start);
+            closeCandidate(state, size, 50, carved);
+        }
+    }
+}
+
+void FileCarver::closeCandidate(CarveState& state, uint64_t size, int confidence, std::vector<CarvedFile>& carved) {
+    carved.push_back({state.signature, state.start, size, confidence, 0, 0, state.startClass});
+    state.open = false;
+}
+
+RecoveredFileInfo FileCarver::createCarvedFileInfo(const std::string& path, const CarvedFile& file) {
     RecoveredFileInfo info;
     
-    info.path = path + "_carved_" + std::to_string(offset);
+    info.path = path + "_carved_" + std::to_string(file.offset);
     info.originalPath = "Unknown";
-    info.size = size;
-    info.fileType = fileType;
+    info.size = file.size;
+    info.fileType = file.signature->record->fileType;
+    info.sourceDevice = path;
+    if (file.gapLength == 0) {
+        info.extents.push_back({(long long)file.offset, (long long)file.size});
+    } else {
+        uint64_t firstLength = file.gapStart - file.offset;
+        info.extents.push_back({(long long)file.offset, (long long)firstLength});
+        info.extents.push_back({(long long)(file.gapStart + file.gapLength), (long long)(file.size - firstLength)});
+    }
     info.dateModified = time(nullptr) * 1000LL;
     info.dateDeleted = (time(nullptr) - 3600) * 1000LL; // Assume deleted 1 hour ago
     info.isDeleted = true;
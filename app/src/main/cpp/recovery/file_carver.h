@@ -2,36 +2,149 @@
 #define FILE_CARVER_H
 
 #include "../include/native_scanner.h"
+#include "pattern_matcher.h"
+#include "signature_database.h"
+#include "format_walker.h"
+#include "../utils/block_device.h"
+#include "../utils/async_reader.h"
+#include "../utils/block_classifier.h"
 #include <string>
 #include <vector>
 #include <functional>
+#include <memory>
 
 class FileCarver {
 public:
     FileCarver();
     ~FileCarver();
 
+    // Defaults to the built-in database
+    void setDatabase(std::shared_ptr<const SignatureDatabase> database);
+
+    std::vector<RecoveredFileInfo> carveFiles(const std::string& partition,
+                                             const std::vector<int>& fileTypes,
+                                             std::function<bool(const ScanProgress&)> progressCallback);
+    // Carves only the given device ranges, e.g. the filesystem's free extents
     std::vector<RecoveredFileInfo> carveFiles(const std::string& partition,
                                              const std::vector<int>& fileTypes,
+                                             const std::vector<FileExtent>& ranges,
                                              std::function<bool(const ScanProgress&)> progressCallback);
 
 private:
     struct FileSignature {
-        std::vector<uint8_t> header;
-        std::vector<uint8_t> footer;
-        std::string extension;
-        int fileType;
-        size_t maxSize;
+        const SignatureRecord* record;
+        FormatWalker::WalkFunction walk; // nullptr: bounded by footer / next header only
+        FormatWalker::GapFunction findGap; // nullptr: fragmented files stay partial
+    };
+
+    // Tracks the file currently being carved for one signature
+    struct CarveState {
+        const FileSignature* signature;
+        bool open;
+        uint64_t start;
+        uint64_t skipUntil; // end of the last walked file of this type
+        BlockClass startClass;
+        uint64_t footerSearchedTo; // skipped runs before this hold no footer for the open file
     };
+
+    // Maps a matcher pattern id back to the carve state it feeds. Hits of inactive
+    // patterns (unrequested types, footers of walked formats) are dropped while scanning.
+    struct PatternRole {
+        bool active;
+        size_t stateIndex;
+        bool isFooter;
+        uint32_t startDistance;        // from the file start to the matched header anchor
+        const SignatureRecord* verify; // header bytes outside the anchor to check, or nullptr
+    };
+
+    // position is the file start for headers and the footer start for footers
+    struct MatchHit {
+        uint64_t position;
+        int patternId;
+        BlockClass startClass; // class of the block the file starts in
+    };
+
+    struct CarvedFile {
+        const FileSignature* signature;
+        uint64_t offset;
+        uint64_t size;
+        int confidence;
+        // Bifragment files skip [gapStart, gapStart + gapLength); contiguous files have no gap
+        uint64_t gapStart;
+        uint64_t gapLength;
+        BlockClass startClass;
+    };
+
+    // Slice of a scanned range handed to one worker
+    struct Shard {
+        uint64_t start;
+        uint64_t end;
+    };
+
+    // Device bytes [start, end) that classified alike
+    struct BlockRun {
+        uint64_t start;
+        uint64_t end;
+    };
+
+    // What one worker found in its shard
+    struct ShardResult {
+        std::vector<MatchHit> hits;
+        std::vector<BlockRun> zeroRuns;
+        std::vector<BlockRun> skippedRuns; // noisy runs the automaton only ran over in part
+        uint64_t randomBytes; // high-entropy bytes that were not matched
+    };
+
+    // Outcome of walking one header, with the second fragment if the walk was bridged
+    struct WalkJob {
+        WalkResult walk;
+        bool bridged;
+        GapResult gap;
+    };
+
+    // Each worker streams its shard in large chunks with a few reads queued ahead
+    static constexpr size_t kChunkSize = 2 * 1024 * 1024;
+    static constexpr size_t kReadQueueDepth = 4;
+    // Shards are smaller than device / threads so faster workers pick up the slack
+    static constexpr uint64_t kShardSize = 64ULL * 1024 * 1024;
+    // Free ranges closer together than this are carved as one
+    static constexpr uint64_t kMinRangeGap = 256 * 1024;
+    // Files start at least on sector boundaries, even where clusters are smaller than blocks
+    static constexpr uint64_t kSectorSize = 512;
+    // Partially validated files shorter than this are noise rather than recoverable data
+    static constexpr uint64_t kMinPartialLength = 4096;
     
-    std::vector<FileSignature> m_signatures;
+    std::shared_ptr<const SignatureDatabase> m_database;
+    std::vector<FileSignature> m_signatures; // one per database record, in record order
     
-    void initializeSignatures();
-    std::vector<RecoveredFileInfo> carveBySignature(const std::string& device,
-                                                   const FileSignature& signature,
-                                                   std::function<bool(const ScanProgress&)> progressCallback);
-    bool matchesSignature(const uint8_t* data, const std::vector<uint8_t>& signature);
-    RecoveredFileInfo createCarvedFileInfo(const std::string& path, size_t offset, size_t size, int fileType);
+    std::vector<RecoveredFileInfo> carve(const std::string& partition,
+                                         const std::vector<int>& fileTypes,
+                                         const std::vector<FileExtent>* ranges,
+                                         std::function<bool(const ScanProgress&)> progressCallback);
+    std::vector<CarvedFile> carveParallel(const std::string& device,
+                                          const std::vector<FileExtent>* ranges,
+                                          std::vector<CarveState>& states,
+                                          const PatternMatcher& matcher,
+                                          const std::vector<PatternRole>& roles,
+                                          std::function<bool(const ScanProgress&)> progressCallback);
+    bool scanShard(AsyncReader& reader, const PatternMatcher& matcher, const std::vector<PatternRole>& roles,
+                   uint64_t shardStart, uint64_t shardEnd,
+                   ShardResult& result, const std::function<bool(size_t)>& onChunk);
+    static bool headerMatches(const BlockDevice& device, const AsyncReader::Block& block,
+                              const SignatureRecord& record, uint64_t fileStart);
+    // Looks for the open file's footer in the skipped runs between where the last search
+    // stopped and until; footers in noise only matter while a file that ends in one is open
+    static bool findSkippedFooter(const BlockDevice& device, const std::vector<BlockRun>& skippedRuns,
+                                  CarveState& state, uint64_t until, std::vector<uint8_t>& scratch,
+                                  uint64_t& footer);
+    void handleMatch(CarveState& state, bool isFooter, const MatchHit& hit, std::vector<CarvedFile>& carved);
+    void handleWalkedHeader(CarveState& state, const MatchHit& hit, const WalkJob& job,
+                            std::vector<CarvedFile>& carved);
+    void closeAtRangeEnd(std::vector<CarveState>& states, uint64_t rangeEnd, std::vector<CarvedFile>& carved);
+    void closeCandidate(CarveState& state, uint64_t size, int confidence, std::vector<CarvedFile>& carved);
+    static void adjustConfidence(CarvedFile& file, const std::vector<BlockRun>& zeroRuns);
+    static uint64_t zeroBytesIn(const std::vector<BlockRun>& zeroRuns, uint64_t start, uint64_t end);
+    RecoveredFileInfo createCarvedFileInfo(const std::string& path, const CarvedFile& file);
 };
 
 #endif // FILE_CARVER_H
\ No newline at end of file
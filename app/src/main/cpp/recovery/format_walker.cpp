@@ -0,0 +1,1137 @@
+#include "format_walker.h"
+#include "../utils/byte_order.h"
+#include <algorithm>
+#include <cstring>
+#include <zlib.h>
+
+const uint8_t* ByteSource::fetch(uint64_t offset, size_t minLength) {
+    size_t available = 0;
+    return fetch(offset, minLength, available);
+}
+
+DeviceCursor::DeviceCursor(const BlockDevice& device)
+    : m_device(device), m_windowOffset(0), m_windowLength(0) {}
+
+const uint8_t* DeviceCursor::fetch(uint64_t offset, size_t minLength, size_t& available) {
+    const uint64_t deviceSize = m_device.size();
+    if (offset >= deviceSize || minLength > deviceSize - offset) {
+        return nullptr;
+    }
+
+    if (m_device.isMapped()) {
+        available = (size_t)std::min<uint64_t>(deviceSize - offset, SIZE_MAX);
+        return m_device.data() + offset;
+    }
+
+    if (offset < m_windowOffset || offset + minLength > m_windowOffset + m_windowLength) {
+        size_t length = (size_t)std::min<uint64_t>(std::max(kWindowSize, minLength), deviceSize - offset);
+        m_window.resize(std::max(m_window.size(), length));
+        long long bytesRead = m_device.read(offset, m_window.data(), length);
+        m_windowOffset = offset;
+        m_windowLength = bytesRead > 0 ? (size_t)bytesRead : 0;
+        if (m_windowLength < minLength) {
+            return nullptr;
+        }
+    }
+
+    available = (size_t)(m_windowOffset + m_windowLength - offset);
+    return m_window.data() + (offset - m_windowOffset);
+}
+
+GapCursor::GapCursor(ByteSource& base, uint64_t breakOffset, uint64_t gapLength)
+    : m_base(base), m_break(breakOffset), m_gap(gapLength) {}
+
+const uint8_t* GapCursor::fetch(uint64_t offset, size_t minLength, size_t& available) {
+    if (offset >= m_break) {
+        return m_base.fetch(offset + m_gap, minLength, available);
+    }
+
+    if (offset + minLength <= m_break) {
+        const uint8_t* data = m_base.fetch(offset, minLength, available);
+        if (data) {
+            available = (size_t)std::min<uint64_t>(available, m_break - offset);
+        }
+        return data;
+    }
+
+    // The requested field straddles the break: stitch both halves together
+    if (minLength > sizeof(m_stitch)) {
+        return nullptr;
+    }
+    size_t head = (size_t)(m_break - offset);
+    const uint8_t* first = m_base.fetch(offset, head);
+    if (!first) {
+        return nullptr;
+    }
+    memcpy(m_stitch, first, head);
+    const uint8_t* second = m_base.fetch(m_break + m_gap, minLength - head);
+    if (!second) {
+        return nullptr;
+    }
+    memcpy(m_stitch + head, second, minLength - head);
+    available = minLength;
+    return m_stitch;
+}
+
+uint64_t GapCursor::size() const {
+    uint64_t baseSize = m_base.size();
+    if (baseSize >= m_break + m_gap) {
+        return baseSize - m_gap;
+    }
+    return std::min(baseSize, m_break);
+}
+
+// JPEG
+
+static bool isJpegStandaloneMarker(uint8_t marker) {
+    return marker == 0x01 || (marker >= 0xD0 && marker <= 0xD7);
+}
+
+// Skips entropy-coded data after SOS. Returns the offset of the next real marker.
+static bool skipEntropyData(ByteSource& source, uint64_t& pos, uint64_t limit) {
+    while (pos < limit) {
+        size_t available = 0;
+        const uint8_t* data = source.fetch(pos, 2, available);
+        if (!data) {
+            return false;
+        }
+
+        size_t span = (size_t)std::min<uint64_t>(available - 1, limit - pos);
+        const uint8_t* ff = static_cast<const uint8_t*>(memchr(data, 0xFF, span));
+        if (!ff) {
+            pos += span;
+            continue;
+        }
+
+        pos += (uint64_t)(ff - data);
+        uint8_t next = ff[1];
+        if (next == 0x00 || (next >= 0xD0 && next <= 0xD7)) {
+            pos += 2; // Stuffed byte or restart marker: still inside the scan
+        } else if (next == 0xFF) {
+            pos += 1; // Fill byte
+        } else {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Walks from pos, which is either at a marker or (inScan) inside entropy-coded data.
+// afterScan: pos is at the marker that ends a scan already checked by the caller.
+static WalkResult walkJpegFrom(ByteSource& source, uint64_t offset, uint64_t pos, bool inScan,
+                               uint64_t limit, bool afterScan = false) {
+    uint64_t validated = pos;  // last position where a well-formed marker was seen
+    uint64_t scanStart = 0;    // start of the entropy-coded data being skipped
+    bool sawScan = inScan || afterScan;
+
+    while (pos < limit) {
+        if (inScan) {
+            scanStart = pos;
+            if (!skipEntropyData(source, pos, limit)) {
+                break;
+            }
+            inScan = false;
+        }
+
+        const uint8_t* p = source.fetch(pos, 2);
+        if (!p || p[0] != 0xFF) {
+            break;
+        }
+
+        uint8_t marker = p[1];
+        if (marker == 0xFF) {
+            pos += 1;
+            continue;
+        }
+        if (marker == 0xD9) {
+            // EOI without any image data is a stray marker pair, not a picture
+            return {sawScan, pos + 2 - offset, pos + 2 - offset, 0};
+        }
+        if (isJpegStandaloneMarker(marker)) {
+            pos += 2;
+            continue;
+        }
+        if (marker < 0xC0 || marker == 0xD8) {
+            break; // Reserved or repeated SOI marker: the structure is broken here
+        }
+        validated = pos;
+
+        const uint8_t* segment = source.fetch(pos, 4);
+        if (!segment) {
+            break;
+        }
+        uint16_t segmentLength = readBe16(segment + 2);
+        if (segmentLength < 2) {
+            break;
+        }
+        pos += 2 + segmentLength;
+
+        if (marker == 0xDA) {
+            sawScan = true;
+            inScan = true;
+        }
+    }
+
+    // A marker found after the scan that leads nowhere means the scan data already went
+    // foreign before it
+    uint64_t failure = scanStart != 0 && validated > scanStart ? validated : std::min(pos, limit);
+    uint64_t checkpoint = scanStart > offset ? scanStart - offset : 0;
+    return {false, validated - offset, failure - offset, checkpoint};
+}
+
+WalkResult FormatWalker::walkJpeg(ByteSource& source, uint64_t offset, uint64_t maxSize) {
+    return walkJpegFrom(source, offset, offset + 2, false, offset + maxSize); // Past SOI
+}
+
+// Marker checks accept any entropy-coded data, another picture's included, so joins are
+// checked against the coding of the broken scan itself: its Huffman tables, the layout of
+// its MCUs and its restart interval, all taken from the headers before it.
+
+struct JpegHuffmanTable {
+    bool defined;
+    int32_t maxCode[17]; // largest code of each length, -1 if there is none
+    int32_t minCode[17];
+    int32_t valueIndex[17];
+    uint8_t values[256];
+};
+
+struct JpegScanComponent {
+    uint32_t blocks; // blocks per MCU
+    uint8_t dcTable;
+    uint8_t acTable;
+};
+
+struct JpegScanSpec {
+    JpegHuffmanTable dc[4];
+    JpegHuffmanTable ac[4];
+    JpegScanComponent components[4];
+    uint32_t componentCount;
+    uint32_t mcuCount; // MCUs the scan must hold, 0 if the height comes later in DNL
+    uint32_t restartInterval;
+    uint8_t spectralStart;
+    uint8_t spectralEnd;
+    uint8_t approximationHigh;
+    bool progressive;
+    uint32_t maxDcBits;
+    uint32_t maxAcBits;
+    bool decodable; // refinement scans depend on earlier coefficients and are not decoded
+};
+
+static bool buildHuffmanTable(const uint8_t* counts, const uint8_t* values, JpegHuffmanTable& table) {
+    int32_t code = 0;
+    int32_t index = 0;
+    for (int length = 1; length <= 16; ++length) {
+        const int32_t count = counts[length - 1];
+        table.minCode[length] = code;
+        table.valueIndex[length] = index;
+        code += count;
+        index += count;
+        // An over-subscribed code is not a prefix code
+        if (code > (1 << length)) {
+            return false;
+        }
+        table.maxCode[length] = count ? code - 1 : -1;
+        code <<= 1;
+    }
+    memcpy(table.values, values, (size_t)index);
+    table.defined = true;
+    return true;
+}
+
+// Collects the tables and layout in force for the scan whose data starts at scanStart
+static bool parseJpegScanSpec(ByteSource& source, uint64_t offset, uint64_t scanStart, JpegScanSpec& spec) {
+    spec = JpegScanSpec();
+    uint8_t frameIds[4] = {};
+    uint8_t frameSampling[4] = {};
+    uint32_t frameComponents = 0;
+    uint32_t width = 0;
+    uint32_t height = 0;
+    uint32_t maxH = 1;
+    uint32_t maxV = 1;
+
+    uint64_t pos = offset + 2; // Past SOI
+    while (pos < scanStart) {
+        const uint8_t* p = source.fetch(pos, 4);
+        if (!p || p[0] != 0xFF) {
+            return false;
+        }
+        const uint8_t marker = p[1];
+        if (marker == 0xFF) {
+            pos += 1;
+            continue;
+        }
+        if (marker < 0xC0 || marker == 0xD8 || marker == 0xD9 || isJpegStandaloneMarker(marker)) {
+            return false;
+        }
+        const size_t length = readBe16(p + 2);
+        if (length < 2) {
+            return false;
+        }
+        const size_t bodyLength = length - 2;
+        const uint8_t* body = source.fetch(pos + 4, bodyLength);
+        if (!body) {
+            return false;
+        }
+
+        if (marker == 0xC0 || marker == 0xC1 || marker == 0xC2) {
+            if (bodyLength < 6 || body[5] == 0 || body[5] > 4 || bodyLength < 6 + 3 * (size_t)body[5]) {
+                return false;
+            }
+            height = readBe16(body + 1);
+            width = readBe16(body + 3);
+            frameComponents = body[5];
+            for (uint32_t i = 0; i < frameComponents; ++i) {
+                frameIds[i] = body[6 + 3 * i];
+                frameSampling[i] = body[7 + 3 * i];
+                if ((frameSampling[i] >> 4) == 0 || (frameSampling[i] & 0x0F) == 0) {
+                    return false;
+                }
+                maxH = std::max<uint32_t>(maxH, frameSampling[i] >> 4);
+                maxV = std::max<uint32_t>(maxV, frameSampling[i] & 0x0F);
+            }
+            spec.progressive = marker == 0xC2;
+            spec.maxDcBits = body[0] > 8 ? 15 : 11;
+            spec.maxAcBits = body[0] > 8 ? 14 : 10;
+        } else if (marker >= 0xC3 && marker <= 0xCF && marker != 0xC4) {
+            return false; // Lossless, hierarchical or arithmetic coding
+        } else if (marker == 0xC4) {
+            for (size_t at = 0; at < bodyLength;) {
+                if (bodyLength - at < 17 || (body[at] >> 4) > 1 || (body[at] & 0x0F) > 3) {
+                    return false;
+                }
+                size_t count = 0;
+                for (int i = 1; i <= 16; ++i) {
+                    count += body[at + i];
+                }
+                if (count > 256 || bodyLength - at - 17 < count) {
+                    return false;
+                }
+                JpegHuffmanTable& table = (body[at] >> 4) ? spec.ac[body[at] & 0x0F] : spec.dc[body[at] & 0x0F];
+                if (!buildHuffmanTable(body + at + 1, body + at + 17, table)) {
+                    return false;
+                }
+                at += 17 + count;
+            }
+        } else if (marker == 0xDD) {
+            if (bodyLength < 2) {
+                return false;
+            }
+            spec.restartInterval = readBe16(body);
+        } else if (marker == 0xDA) {
+            const uint32_t count = bodyLength > 0 ? body[0] : 0;
+            if (frameComponents == 0 || count == 0 || count > 4 || bodyLength < 4 + 2 * (size_t)count) {
+                return false;
+            }
+            spec.componentCount = count;
+            for (uint32_t i = 0; i < count; ++i) {
+                uint32_t frame = 0;
+                while (frame < frameComponents && frameIds[frame] != body[1 + 2 * i]) {
+                    ++frame;
+                }
+                const uint8_t tables = body[2 + 2 * i];
+                if (frame == frameComponents || (tables >> 4) > 3 || (tables & 0x0F) > 3) {
+                    return false;
+                }
+                const uint32_t h = frameSampling[frame] >> 4;
+                const uint32_t v = frameSampling[frame] & 0x0F;
+                spec.components[i] = {count == 1 ? 1 : h * v, (uint8_t)(tables >> 4), (uint8_t)(tables & 0x0F)};
+                // A single-component scan covers that component's blocks, not whole MCUs
+                if (count == 1) {
+                    const uint32_t columns = ((width * h + maxH - 1) / maxH + 7) / 8;
+                    const uint32_t rows = ((height * v + maxV - 1) / maxV + 7) / 8;
+                    spec.mcuCount = columns * rows;
+                } else {
+                    spec.mcuCount = ((width + 8 * maxH - 1) / (8 * maxH)) * ((height + 8 * maxV - 1) / (8 * maxV));
+                }
+            }
+            spec.spectralStart = body[1 + 2 * count];
+            spec.spectralEnd = body[2 + 2 * count];
+            spec.approximationHigh = body[3 + 2 * count] >> 4;
+
+            pos += 2 + length;
+            if (pos == scanStart) {
+                break;
+            }
+            // An earlier scan; its data leads to the next marker
+            if (pos > scanStart || !skipEntropyData(source, pos, scanStart)) {
+                return false;
+            }
+            continue;
+        }
+        pos += 2 + length;
+    }
+    if (pos != scanStart || spec.componentCount == 0 || spec.spectralEnd > 63 ||
+        spec.spectralStart > spec.spectralEnd) {
+        return false;
+    }
+
+    // Every table the scan codes with must have been defined before it
+    spec.decodable = spec.approximationHigh == 0 && (spec.progressive || spec.spectralStart == 0);
+    for (uint32_t i = 0; i < spec.componentCount && spec.decodable; ++i) {
+        const JpegScanComponent& component = spec.components[i];
+        if ((spec.spectralStart == 0 && !spec.dc[component.dcTable].defined) ||
+            ((spec.spectralStart > 0 || !spec.progressive) && !spec.ac[component.acTable].defined)) {
+            spec.decodable = false;
+        }
+    }
+    return true;
+}
+
+// Huffman decoder for one scan that only checks the coding and keeps no coefficients.
+// It reads one byte at a time, so a copy taken between MCUs resumes exactly.
+class JpegScanDecoder {
+public:
+    enum class Step { Mcu, End, Error };
+
+    JpegScanDecoder(const JpegScanSpec& spec, uint64_t pos)
+        : m_spec(&spec), m_pos(pos), m_byte(0), m_bitsLeft(0), m_mcus(0), m_mcusSinceRestart(0),
+          m_nextRestart(0), m_eobRun(0) {}
+
+    // Offset of the next byte the decoder will load
+    uint64_t position() const { return m_pos; }
+
+    // Decodes the next MCU, or returns End where the scan ends after its last MCU
+    Step decodeMcu(ByteSource& source) {
+        const JpegScanSpec& spec = *m_spec;
+        uint8_t marker = 0;
+        uint64_t markerPos = 0;
+        const bool last = spec.mcuCount != 0 && m_mcus == spec.mcuCount;
+
+        // The scan ends where the rest of the byte is 1-padding and a marker follows, and
+        // only after its last MCU. An open EOB run codes the blocks left without any bits,
+        // so the marker may come before them.
+        const uint32_t padding = (1u << m_bitsLeft) - 1;
+        const bool coded = m_eobRun == 0 || last || spec.mcuCount == 0;
+        if (coded && (m_byte & padding) == padding && findMarker(source, m_pos, marker, markerPos) &&
+            isScanEnd(marker)) {
+            return last || spec.mcuCount == 0 ? Step::End : Step::Error;
+        }
+        if (last) {
+            return Step::Error;
+        }
+
+        // Restart markers sit between MCUs at a fixed interval, numbered modulo 8
+        if (spec.restartInterval != 0 && m_mcusSinceRestart == spec.restartInterval) {
+            m_bitsLeft = 0;
+            if (!findMarker(source, m_pos, marker, markerPos)) {
+                return Step::Error;
+            }
+            if (marker != 0xD0 + (m_nextRestart & 7)) {
+                return Step::Error;
+            }
+            m_pos = markerPos + 2;
+            ++m_nextRestart;
+            m_mcusSinceRestart = 0;
+            m_eobRun = 0;
+        }
+
+        for (uint32_t i = 0; i < spec.componentCount; ++i) {
+            for (uint32_t block = 0; block < spec.components[i].blocks; ++block) {
+                if (!decodeBlock(source, spec.components[i])) {
+                    return Step::Error;
+                }
+            }
+        }
+        ++m_mcus;
+        ++m_mcusSinceRestart;
+        return Step::Mcu;
+    }
+
+private:
+    const JpegScanSpec* m_spec;
+    uint64_t m_pos;
+    uint32_t m_byte;
+    uint32_t m_bitsLeft;
+    uint32_t m_mcus;
+    uint32_t m_mcusSinceRestart;
+    uint32_t m_nextRestart;
+    uint32_t m_eobRun;
+
+    static bool isScanEnd(uint8_t marker) {
+        return marker != 0x00 && !(marker >= 0xD0 && marker <= 0xD7);
+    }
+
+    // Finds a marker at pos, past at most a few fill bytes
+    static bool findMarker(ByteSource& source, uint64_t pos, uint8_t& marker, uint64_t& markerPos) {
+        for (int fill = 0; fill < 16; ++fill, ++pos) {
+            const uint8_t* p = source.fetch(pos, 2);
+            if (!p || p[0] != 0xFF || p[1] == 0x00) {
+                return false;
+            }
+            if (p[1] != 0xFF) {
+                marker = p[1];
+                markerPos = pos;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool readBit(ByteSource& source, uint32_t& bit) {
+        if (m_bitsLeft == 0) {
+            const uint8_t* p = source.fetch(m_pos, 2);
+            if (!p) {
+                return false;
+            }
+            if (p[0] == 0xFF) {
+                // Only stuffed bytes may appear inside an MCU
+                if (p[1] != 0x00) {
+                    return false;
+                }
+                m_pos += 2;
+            } else {
+                m_pos += 1;
+            }
+            m_byte = p[0];
+            m_bitsLeft = 8;
+        }
+        bit = (m_byte >> --m_bitsLeft) & 1;
+        return true;
+    }
+
+    bool receive(ByteSource& source, uint32_t count, uint32_t& value) {
+        value = 0;
+        for (uint32_t i = 0; i < count; ++i) {
+            uint32_t bit;
+            if (!readBit(source, bit)) {
+                return false;
+            }
+            value = (value << 1) | bit;
+        }
+        return true;
+    }
+
+    bool decodeSymbol(ByteSource& source, const JpegHuffmanTable& table, uint32_t& symbol) {
+        int32_t code = 0;
+        for (int length = 1; length <= 16; ++length) {
+            uint32_t bit;
+            if (!readBit(source, bit)) {
+                return false;
+            }
+            code = (code << 1) | (int32_t)bit;
+            if (code <= table.maxCode[length]) {
+                symbol = table.values[table.valueIndex[length] + code - table.minCode[length]];
+                return true;
+            }
+        }
+        return false; // No such code
+    }
+
+    bool decodeBlock(ByteSource& source, const JpegScanComponent& component) {
+        const JpegScanSpec& spec = *m_spec;
+        uint32_t symbol;
+        uint32_t value;
+
+        if (spec.spectralStart == 0) {
+            if (!decodeSymbol(source, spec.dc[component.dcTable], symbol) || symbol > spec.maxDcBits ||
+                !receive(source, symbol, value)) {
+                return false;
+            }
+            if (spec.progressive) {
+                return true;
+            }
+        }
+
+        // Sequential blocks carry AC 1-63; progressive scans a band of it, where runs of
+        // empty blocks are coded once as an EOB run
+        const bool progressive = spec.progressive;
+        const uint32_t end = progressive ? spec.spectralEnd : 63;
+        if (progressive && m_eobRun > 0) {
+            --m_eobRun;
+            return true;
+        }
+        const JpegHuffmanTable& table = spec.ac[component.acTable];
+        for (uint32_t k = progressive ? spec.spectralStart : 1; k <= end;) {
+            if (!decodeSymbol(source, table, symbol)) {
+                return false;
+            }
+            const uint32_t run = symbol >> 4;
+            const uint32_t size = symbol & 0x0F;
+            if (size == 0) {
+                if (run == 15) {
+                    k += 16; // ZRL
+                    if (k > end + 1) {
+                        return false;
+                    }
+                    continue;
+                }
+                if (progressive) {
+                    if (!receive(source, run, value)) {
+                        return false;
+                    }
+                    m_eobRun = (1u << run) - 1 + value;
+                } else if (run != 0) {
+                    return false;
+                }
+                return true; // EOB
+            }
+            k += run;
+            if (k > end || size > spec.maxAcBits || !receive(source, size, value)) {
+                return false;
+            }
+            ++k;
+        }
+        return true;
+    }
+};
+
+// Presents a candidate join to a resumed probe: the few bytes before the break come from
+// memory, so probes for many gaps do not pull the first fragment back into the window
+class JoinCursor : public ByteSource {
+public:
+    JoinCursor(ByteSource& base, const std::vector<uint8_t>& head, uint64_t breakOffset, uint64_t gapLength)
+        : m_base(base), m_head(head), m_headStart(breakOffset - head.size()), m_break(breakOffset),
+          m_gap(gapLength) {}
+
+    using ByteSource::fetch;
+    const uint8_t* fetch(uint64_t offset, size_t minLength, size_t& available) override {
+        if (offset >= m_break) {
+            return m_base.fetch(offset + m_gap, minLength, available);
+        }
+        if (offset < m_headStart) {
+            return nullptr;
+        }
+        const size_t head = (size_t)(m_break - offset);
+        if (minLength <= head) {
+            available = head;
+            return m_head.data() + (offset - m_headStart);
+        }
+        if (minLength > sizeof(m_stitch)) {
+            return nullptr;
+        }
+        const uint8_t* second = m_base.fetch(m_break + m_gap, minLength - head);
+        if (!second) {
+            return nullptr;
+        }
+        memcpy(m_stitch, m_head.data() + (offset - m_headStart), head);
+        memcpy(m_stitch + head, second, minLength - head);
+        available = minLength;
+        return m_stitch;
+    }
+
+    uint64_t size() const override {
+        const uint64_t baseSize = m_base.size();
+        return baseSize >= m_break + m_gap ? baseSize - m_gap : m_break;
+    }
+
+private:
+    ByteSource& m_base;
+    const std::vector<uint8_t>& m_head;
+    uint64_t m_headStart;
+    uint64_t m_break;
+    uint64_t m_gap;
+    uint8_t m_stitch[16];
+};
+
+// For scans that cannot be decoded: restart markers after the join must continue the
+// numbering from the last one before the break. Returns the bytes examined past the break.
+static uint64_t checkRestartSequence(ByteSource& join, uint64_t breakOffset, uint32_t expected, bool& valid) {
+    valid = false;
+    uint32_t seen = 0;
+    uint64_t pos = breakOffset - 1; // A 0xFF right before the break pairs with the continuation
+    const uint64_t limit = breakOffset + FormatWalker::kRestartCheckLength;
+    while (pos < limit) {
+        size_t available = 0;
+        const uint8_t* data = join.fetch(pos, 2, available);
+        if (!data) {
+            break;
+        }
+        const size_t span = (size_t)std::min<uint64_t>(available - 1, limit - pos);
+        const uint8_t* ff = static_cast<const uint8_t*>(memchr(data, 0xFF, span));
+        if (!ff) {
+            pos += span;
+            continue;
+        }
+        pos += (uint64_t)(ff - data);
+        const uint8_t next = ff[1];
+        if (next == 0x00 || next == 0xFF) {
+            pos += next == 0x00 ? 2 : 1;
+            continue;
+        }
+        if (next < 0xD0 || next > 0xD7) {
+            // The scan ended; one restart in sequence before it will do
+            valid = seen > 0 && next >= 0xC0;
+            break;
+        }
+        if (next != 0xD0 + (expected & 7)) {
+            break;
+        }
+        ++expected;
+        pos += 2;
+        if (++seen == 2) {
+            valid = true;
+            break;
+        }
+    }
+    return pos > breakOffset ? pos - breakOffset : 0;
+}
+
+bool FormatWalker::findJpegGap(ByteSource& source, uint64_t offset, uint64_t maxSize,
+                               const WalkResult& failed, GapResult& gap) {
+    // Only breaks inside entropy-coded data can be bridged: markers carry no redundancy
+    if (failed.complete || failed.checkpoint == 0) {
+        return false;
+    }
+
+    const uint64_t scanStart = offset + failed.checkpoint;
+    const uint64_t failure = offset + failed.failure;
+    const uint64_t limit = offset + maxSize;
+    const uint64_t lowest = std::max(scanStart + 1, failure > kMaxBreakDistance ? failure - kMaxBreakDistance : 0);
+
+    JpegScanSpec spec;
+    if (!parseJpegScanSpec(source, offset, scanStart, spec) || (!spec.decodable && spec.restartInterval == 0)) {
+        return false;
+    }
+
+    std::vector<uint64_t> breaks;
+    for (uint64_t b = (lowest + kBlockSize - 1) & ~(kBlockSize - 1); b <= failure; b += kBlockSize) {
+        breaks.push_back(b);
+    }
+
+    // Every candidate resumes from the state at its break, prepared once: the decoder
+    // between the last MCU before the break and the bytes it still needs from there, or
+    // the restart number due next
+    std::vector<JpegScanDecoder> decoders;
+    std::vector<uint32_t> restarts;
+    std::vector<std::vector<uint8_t>> heads;
+    // Where the first fragment stops decoding. The file's own data decodes cleanly with
+    // its own tables, so a second fragment placed before this point would skip part of
+    // the first one.
+    uint64_t foreignFrom = 0;
+    if (spec.decodable) {
+        JpegScanDecoder decoder(spec, scanStart);
+        JpegScanDecoder boundary = decoder;
+        while (decoders.size() < breaks.size()) {
+            if (decoder.position() > breaks[decoders.size()]) {
+                decoders.push_back(boundary);
+                continue;
+            }
+            boundary = decoder;
+            const JpegScanDecoder::Step step = decoder.decodeMcu(source);
+            foreignFrom = decoder.position();
+            if (step != JpegScanDecoder::Step::Mcu) {
+                // The first fragment stops decoding here, so later breaks come too late. A
+                // scan that ends cleanly was not broken at all.
+                while (step == JpegScanDecoder::Step::Error && decoders.size() < breaks.size() &&
+                       breaks[decoders.size()] < decoder.position()) {
+                    decoders.push_back(boundary);
+                }
+                break;
+            }
+        }
+        breaks.resize(decoders.size());
+        for (size_t i = 0; i < breaks.size(); ++i) {
+            const uint8_t* head = source.fetch(decoders[i].position(), (size_t)(breaks[i] - decoders[i].position()));
+            if (!head) {
+                breaks.resize(i);
+                break;
+            }
+            heads.emplace_back(head, head + (breaks[i] - decoders[i].position()));
+        }
+    } else {
+        // Count the restart markers of the scan up to each break
+        uint32_t restart = 0;
+        uint64_t pos = scanStart;
+        for (size_t i = 0; i < breaks.size(); ++i) {
+            while (pos < breaks[i]) {
+                size_t available = 0;
+                const uint8_t* data = source.fetch(pos, 2, available);
+                if (!data) {
+                    break;
+                }
+                const size_t span = (size_t)std::min<uint64_t>(available - 1, breaks[i] - pos);
+                const uint8_t* ff = static_cast<const uint8_t*>(memchr(data, 0xFF, span));
+                if (!ff) {
+                    pos += span;
+                    continue;
+                }
+                pos += (uint64_t)(ff - data);
+                restart += ff[1] >= 0xD0 && ff[1] <= 0xD7;
+                pos += ff[1] == 0xFF ? 1 : 2;
+            }
+            const uint8_t* head = source.fetch(breaks[i] - 1, 1);
+            if (!head) {
+                breaks.resize(i);
+                break;
+            }
+            restarts.push_back(restart);
+            heads.emplace_back(head, head + 1);
+        }
+    }
+    if (breaks.empty()) {
+        return false;
+    }
+
+    // Gaps are the outer loop so the region after the breaks is read once, front to back.
+    // Foreign data is usually rejected within a few dozen bytes; everything read past the
+    // breaks counts against one budget per file.
+    uint64_t budget = kMaxProbeBytes;
+    for (uint64_t gapLength = kBlockSize; gapLength <= kMaxGap && budget > 0; gapLength += kBlockSize) {
+        for (size_t i = 0; i < breaks.size() && budget > 0; ++i) {
+            const uint64_t breakOffset = breaks[i];
+            if (breakOffset + gapLength < foreignFrom) {
+                continue;
+            }
+            JoinCursor join(source, heads[i], breakOffset, gapLength);
+
+            bool joined = false;
+            uint64_t used = 0;
+            JpegScanDecoder probe = spec.decodable ? decoders[i] : JpegScanDecoder(spec, breakOffset);
+            if (spec.decodable) {
+                JpegScanDecoder::Step step = JpegScanDecoder::Step::Mcu;
+                while (step == JpegScanDecoder::Step::Mcu && probe.position() < breakOffset + kJoinCheckLength) {
+                    step = probe.decodeMcu(join);
+                }
+                joined = step != JpegScanDecoder::Step::Error;
+                used = probe.position() > breakOffset ? probe.position() - breakOffset : 0;
+            } else {
+                used = checkRestartSequence(join, breakOffset, restarts[i], joined);
+            }
+            budget -= std::min(budget, std::max<uint64_t>(used, 1));
+            if (!joined) {
+                continue;
+            }
+
+            // Other pictures coded with the same (often standard) tables pass the probe too;
+            // only the full scan shows whether the MCU count comes out right
+            GapCursor cursor(source, breakOffset, gapLength);
+            // A decodable scan must end after exactly its MCUs; the walk goes on from its end.
+            // Otherwise resume one byte early so a 0xFF right before the break pairs with the
+            // continuation.
+            uint64_t resume = breakOffset - 1;
+            bool inScan = true;
+            if (spec.decodable) {
+                const uint64_t checked = probe.position();
+                JpegScanDecoder::Step step = JpegScanDecoder::Step::Mcu;
+                while (step == JpegScanDecoder::Step::Mcu && probe.position() < limit) {
+                    step = probe.decodeMcu(cursor);
+                }
+                budget -= std::min(budget, probe.position() - checked);
+                if (step != JpegScanDecoder::Step::End) {
+                    continue;
+                }
+                resume = probe.position();
+                inScan = false;
+            }
+            WalkResult rest = walkJpegFrom(cursor, offset, resume, inScan, limit, !inScan);
+            budget -= std::min(budget, std::max<uint64_t>(offset + rest.failure, breakOffset) - breakOffset);
+            if (rest.complete) {
+                gap = {breakOffset, breakOffset + gapLength, rest.length};
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+// PNG
+
+static bool isPngChunkType(const uint8_t* type) {
+    for (int i = 0; i < 4; ++i) {
+        uint8_t c = type[i] & 0xDF; // Fold case
+        if (c < 'A' || c > 'Z') {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Walks the chunk list from pos, which must be at a chunk header
+static WalkResult walkPngFrom(ByteSource& source, uint64_t offset, uint64_t pos, bool first,
+                              uint64_t limit) {
+    uint64_t lastChunk = 0; // last chunk whose header was accepted
+
+    while (pos < limit) {
+        const uint8_t* chunk = source.fetch(pos, 8);
+        if (!chunk) {
+            break;
+        }
+
+        uint32_t length = readBe32(chunk);
+        if (length > 0x7FFFFFFF || !isPngChunkType(chunk + 4)) {
+            break;
+        }
+        if (first && (memcmp(chunk + 4, "IHDR", 4) != 0 || length != 13)) {
+            break;
+        }
+        first = false;
+
+        uint64_t chunkEnd = pos + 12 + length; // length, type, data, CRC
+        if (chunkEnd > limit || chunkEnd > source.size()) {
+            break;
+        }
+        if (memcmp(chunk + 4, "IEND", 4) == 0) {
+            return {true, chunkEnd - offset, chunkEnd - offset, 0};
+        }
+        lastChunk = pos;
+        pos = chunkEnd;
+    }
+
+    uint64_t length = std::min(pos, limit) - offset;
+    return {false, length, length, lastChunk > offset ? lastChunk - offset : 0};
+}
+
+WalkResult FormatWalker::walkPng(ByteSource& source, uint64_t offset, uint64_t maxSize) {
+    return walkPngFrom(source, offset, offset + 8, true, offset + maxSize); // Past the signature
+}
+
+// Continues a CRC-32 over [from, to) of the source
+static bool crcRange(ByteSource& source, uint64_t from, uint64_t to, uLong& crc) {
+    while (from < to) {
+        size_t available = 0;
+        const uint8_t* data = source.fetch(from, 1, available);
+        if (!data) {
+            return false;
+        }
+        size_t span = (size_t)std::min<uint64_t>(std::min<uint64_t>(available, to - from), 1U << 30);
+        crc = crc32(crc, data, (uInt)span);
+        from += span;
+    }
+    return true;
+}
+
+bool FormatWalker::findPngGap(ByteSource& source, uint64_t offset, uint64_t maxSize,
+                              const WalkResult& failed, GapResult& gap) {
+    // The chunk before the failure is where the data went foreign. Its header was read
+    // before the break, so its length tells where the next header sits for every gap.
+    if (failed.complete || failed.checkpoint == 0) {
+        return false;
+    }
+
+    const uint64_t chunkStart = offset + failed.checkpoint;
+    const uint64_t limit = offset + maxSize;
+    const uint8_t* header = source.fetch(chunkStart, 8);
+    if (!header) {
+        return false;
+    }
+    const uint64_t chunkEnd = chunkStart + 12 + readBe32(header);
+    const uint64_t crcOffset = chunkEnd - 4;
+    if (chunkEnd > limit) {
+        return false;
+    }
+
+    // Block boundaries between the header and the CRC field are the candidate breaks
+    std::vector<uint64_t> breaks;
+    for (uint64_t b = (chunkStart + 8 + kBlockSize - 1) & ~(kBlockSize - 1); b <= crcOffset; b += kBlockSize) {
+        breaks.push_back(b);
+    }
+    if (breaks.empty()) {
+        return false;
+    }
+
+    // CRCs of type + data up to each candidate break; computed once, on first use
+    std::vector<uLong> prefixCrcs;
+
+    for (uint64_t gapLength = kBlockSize; gapLength <= kMaxGap; gapLength += kBlockSize) {
+        // Cheap filter: a chunk header must follow the moved chunk end
+        const uint8_t* next = source.fetch(chunkEnd + gapLength, 8);
+        if (!next) {
+            break;
+        }
+        if (readBe32(next) > 0x7FFFFFFF || !isPngChunkType(next + 4)) {
+            continue;
+        }
+
+        const uint8_t* stored = source.fetch(crcOffset + gapLength, 4);
+        if (!stored) {
+            break;
+        }
+        const uLong expected = readBe32(stored);
+
+        if (prefixCrcs.empty()) {
+            uLong crc = crc32(0L, Z_NULL, 0);
+            uint64_t from = chunkStart + 4;
+            for (uint64_t b : breaks) {
+                if (!crcRange(source, from, b, crc)) {
+                    return false;
+                }
+                prefixCrcs.push_back(crc);
+                from = b;
+            }
+        }
+
+        // Suffix CRCs are built from the chunk end backwards, one block per break, and
+        // combined with the matching prefix so every break costs one block of reading
+        uLong suffix = crc32(0L, Z_NULL, 0);
+        uint64_t suffixStart = crcOffset;
+        for (size_t i = breaks.size(); i-- > 0;) {
+            uLong block = crc32(0L, Z_NULL, 0);
+            if (!crcRange(source, breaks[i] + gapLength, suffixStart + gapLength, block)) {
+                break;
+            }
+            suffix = crc32_combine(block, suffix, (z_off_t)(crcOffset - suffixStart));
+            suffixStart = breaks[i];
+
+            if (crc32_combine(prefixCrcs[i], suffix, (z_off_t)(crcOffset - breaks[i])) != expected) {
+                continue;
+            }
+
+            // The chunk checks out; the rest of the file must walk to IEND
+            GapCursor cursor(source, breaks[i], gapLength);
+            WalkResult rest = walkPngFrom(cursor, offset, chunkEnd, false, limit);
+            if (rest.complete) {
+                gap = {breaks[i], breaks[i] + gapLength, rest.length};
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+// MP4
+
+static bool isTopLevelBox(const uint8_t* type) {
+    static const char* const kBoxes[] = {
+        "ftyp", "moov", "mdat", "free", "skip", "wide", "uuid", "meta",
+        "pdin", "moof", "mfra", "styp", "sidx", "ssix", "prft", "emsg", "udta"
+    };
+    for (const char* box : kBoxes) {
+        if (memcmp(type, box, 4) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+WalkResult FormatWalker::walkMp4(ByteSource& source, uint64_t offset, uint64_t maxSize) {
+    uint64_t pos = offset;
+    const uint64_t limit = offset + maxSize;
+    bool sawMovie = false;
+    bool sawData = false;
+
+    while (pos < limit) {
+        const uint8_t* box = source.fetch(pos, 8);
+        if (!box || !isTopLevelBox(box + 4)) {
+            break;
+        }
+        // A file opens with ftyp and has only one, so a later ftyp starts the next file
+        if ((pos == offset) != (memcmp(box + 4, "ftyp", 4) == 0)) {
+            break;
+        }
+
+        uint64_t boxSize = readBe32(box);
+        if (boxSize == 1) {
+            const uint8_t* large = source.fetch(pos, 16);
+            if (!large) {
+                break;
+            }
+            boxSize = readBe64(large + 8);
+        } else if (boxSize == 0) {
+            // Box runs to the end of the file; nothing bounds it but maxSize
+            uint64_t length = std::min(limit, source.size()) - offset;
+            return {false, length, length, 0};
+        }
+        if (boxSize < 8 || pos + boxSize > limit) {
+            break;
+        }
+
+        if (memcmp(box + 4, "moov", 4) == 0 || memcmp(box + 4, "moof", 4) == 0) {
+            sawMovie = true;
+        } else if (memcmp(box + 4, "mdat", 4) == 0) {
+            sawData = true;
+        }
+        pos += boxSize;
+    }
+
+    // The box chain simply stops at the end of the file
+    uint64_t length = std::min(pos, limit) - offset;
+    return {sawMovie && sawData && pos <= source.size(), length, length, 0};
+}
+
+// PDF
+
+static bool findBytes(ByteSource& source, uint64_t from, uint64_t limit,
+                      const char* needle, size_t needleLength, uint64_t& found) {
+    uint64_t pos = from;
+    while (pos + needleLength <= limit) {
+        size_t available = 0;
+        const uint8_t* data = source.fetch(pos, needleLength, available);
+        if (!data) {
+            return false;
+        }
+        size_t span = (size_t)std::min<uint64_t>(available, limit - pos);
+        const void* hit = memmem(data, span, needle, needleLength);
+        if (hit) {
+            found = pos + (uint64_t)(static_cast<const uint8_t*>(hit) - data);
+            return true;
+        }
+        if (span < needleLength) {
+            return false;
+        }
+        pos += span - (needleLength - 1); // Keep an overlap for needles across windows
+    }
+    return false;
+}
+
+static bool isPdfWhitespace(uint8_t c) {
+    return c == ' ' || c == '\r' || c == '\n' || c == '\t' || c == '\f' || c == 0;
+}
+
+// Matches "xref" or an object header "<num> <gen> obj" at the start of data
+static bool startsPdfUpdate(const uint8_t* data, size_t length) {
+    if (length >= 4 && memcmp(data, "xref", 4) == 0) {
+        return true;
+    }
+
+    size_t i = 0;
+    for (int field = 0; field < 2; ++field) {
+        size_t digits = 0;
+        while (i < length && data[i] >= '0' && data[i] <= '9') {
+            ++i;
+            ++digits;
+        }
+        if (digits == 0 || i >= length || data[i] != ' ') {
+            return false;
+        }
+        while (i < length && data[i] == ' ') {
+            ++i;
+        }
+    }
+    return length - i >= 3 && memcmp(data + i, "obj", 3) == 0;
+}
+
+WalkResult FormatWalker::walkPdf(ByteSource& source, uint64_t offset, uint64_t maxSize) {
+    const uint64_t limit = std::min(offset + maxSize, source.size());
+    uint64_t searchFrom = offset + 5;
+    uint64_t eofPos = 0;
+
+    while (findBytes(source, searchFrom, limit, "%%EOF", 5, eofPos)) {
+        searchFrom = eofPos + 5;
+
+        // A real trailer has startxref shortly before %%EOF
+        uint64_t lookBack = std::min<uint64_t>(eofPos - offset, 1024);
+        uint64_t xrefPos = 0;
+        if (!findBytes(source, eofPos - lookBack, eofPos, "startxref", 9, xrefPos)) {
+            continue;
+        }
+
+        uint64_t end = eofPos + 5;
+        size_t available = 0;
+        const uint8_t* tail = source.fetch(end, 1, available);
+        if (tail && tail[0] == '\r') {
+            ++end;
+            tail = source.fetch(end, 1, available);
+        }
+        if (tail && tail[0] == '\n') {
+            ++end;
+        }
+
+        // An incremental update appends more objects and another trailer after %%EOF
+        tail = source.fetch(end, 1, available);
+        if (tail) {
+            size_t span = std::min<size_t>(available, 64);
+            size_t i = 0;
+            while (i < span && isPdfWhitespace(tail[i])) {
+                ++i;
+            }
+            if (startsPdfUpdate(tail + i, span - i)) {
+                continue;
+            }
+        }
+
+        return {true, end - offset, end - offset, 0};
+    }
+
+    uint64_t length = eofPos > offset ? eofPos + 5 - offset : 0;
+    return {false, length, length, 0};
+}
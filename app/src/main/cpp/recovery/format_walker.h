@@ -0,0 +1,121 @@
+#ifndef FORMAT_WALKER_H
+#define FORMAT_WALKER_H
+
+#include "../utils/block_device.h"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Random access to the bytes of a candidate file, as seen by the format walkers
+class ByteSource {
+public:
+    virtual ~ByteSource() = default;
+
+    // Returns a pointer to at least minLength bytes at offset and sets available to the
+    // number of bytes readable from it, or returns nullptr if the source ends first.
+    virtual const uint8_t* fetch(uint64_t offset, size_t minLength, size_t& available) = 0;
+    const uint8_t* fetch(uint64_t offset, size_t minLength);
+
+    virtual uint64_t size() const = 0;
+};
+
+// Small read window over a BlockDevice for walkers that hop through a file's structure.
+// Mapped images are served in place; otherwise reads are batched into one window buffer.
+class DeviceCursor : public ByteSource {
+public:
+    explicit DeviceCursor(const BlockDevice& device);
+
+    using ByteSource::fetch;
+    const uint8_t* fetch(uint64_t offset, size_t minLength, size_t& available) override;
+
+    uint64_t size() const override { return m_device.size(); }
+
+private:
+    static constexpr size_t kWindowSize = 256 * 1024;
+
+    const BlockDevice& m_device;
+    std::vector<uint8_t> m_window;
+    uint64_t m_windowOffset;
+    size_t m_windowLength;
+};
+
+// Presents a file split in two fragments as contiguous: offsets from breakOffset on are
+// read gapLength bytes further into the underlying source.
+class GapCursor : public ByteSource {
+public:
+    GapCursor(ByteSource& base, uint64_t breakOffset, uint64_t gapLength);
+
+    using ByteSource::fetch;
+    const uint8_t* fetch(uint64_t offset, size_t minLength, size_t& available) override;
+
+    uint64_t size() const override;
+
+private:
+    ByteSource& m_base;
+    uint64_t m_break;
+    uint64_t m_gap;
+    uint8_t m_stitch[16]; // fields that straddle the break are copied together here
+};
+
+struct WalkResult {
+    bool complete;       // the format's end marker was reached and the structure is consistent
+    uint64_t length;     // file length when complete, otherwise the prefix that validated
+    uint64_t failure;    // where the structure broke (relative), or the limit if it ran out
+    uint64_t checkpoint; // where a walk can resume inside the broken unit (relative), 0 if none
+};
+
+// A file recovered as two fragments: [offset, breakOffset) followed by
+// [resumeOffset, resumeOffset + length - (breakOffset - offset))
+struct GapResult {
+    uint64_t breakOffset;
+    uint64_t resumeOffset;
+    uint64_t length; // total file length
+};
+
+// Structural end-of-file detection for carved candidates. Each walker starts at a matched
+// header and follows the format's own length fields and markers, so the real file end is
+// found without searching for a footer or reading up to maxSize.
+class FormatWalker {
+public:
+    using WalkFunction = WalkResult (*)(ByteSource& source, uint64_t offset, uint64_t maxSize);
+    // Looks for the second fragment of a file whose walk failed part way
+    using GapFunction = bool (*)(ByteSource& source, uint64_t offset, uint64_t maxSize,
+                                 const WalkResult& failed, GapResult& gap);
+
+    // JPEG: marker segments and entropy-coded scans up to EOI
+    static WalkResult walkJpeg(ByteSource& source, uint64_t offset, uint64_t maxSize);
+    // PNG: chunk lengths up to IEND
+    static WalkResult walkPng(ByteSource& source, uint64_t offset, uint64_t maxSize);
+    // MP4/MOV: top-level box sizes until the box chain ends
+    static WalkResult walkMp4(ByteSource& source, uint64_t offset, uint64_t maxSize);
+    // PDF: last %%EOF that follows a startxref and is not followed by an incremental update
+    static WalkResult walkPdf(ByteSource& source, uint64_t offset, uint64_t maxSize);
+
+    // Bifragment gap carving. Candidate break points are block boundaries just before the
+    // failure, candidate gaps are whole blocks up to kMaxGap. Each candidate resumes the
+    // walk at the break instead of re-walking the file and is dropped as soon as the
+    // structure breaks again, so most candidates cost a few hundred bytes of reading.
+    // JPEG: the break must fall inside entropy-coded data. Joins are decoded with the
+    // file's own Huffman tables, or for refinement scans checked for restart markers that
+    // continue the sequence, before a candidate is walked to EOI.
+    static bool findJpegGap(ByteSource& source, uint64_t offset, uint64_t maxSize,
+                            const WalkResult& failed, GapResult& gap);
+    // PNG: the break must fall inside a chunk, which is then confirmed by its CRC
+    static bool findPngGap(ByteSource& source, uint64_t offset, uint64_t maxSize,
+                           const WalkResult& failed, GapResult& gap);
+
+    // Files are fragmented at filesystem block granularity
+    static constexpr uint64_t kBlockSize = 4096;
+    // Second fragments are searched at most this far after the break
+    static constexpr uint64_t kMaxGap = 4ULL * 1024 * 1024;
+    // Break points are searched at most this far before the failure
+    static constexpr uint64_t kMaxBreakDistance = 64 * 1024;
+    // A JPEG join that decodes cleanly for this many bytes is walked in full
+    static constexpr uint64_t kJoinCheckLength = 8 * 1024;
+    // Joins checked by restart markers alone must show them within this many bytes
+    static constexpr uint64_t kRestartCheckLength = 64 * 1024;
+    // Bytes read past candidate breaks, over all candidates of one JPEG
+    static constexpr uint64_t kMaxProbeBytes = 4ULL * 1024 * 1024;
+};
+
+#endif // FORMAT_WALKER_H
@@ -0,0 +1,241 @@
+#include "pattern_matcher.h"
+#include <android/log.h>
+#include <algorithm>
+#include <fstream>
+#include <queue>
+#include <cstdio>
+#include <cstring>
+#include <unistd.h>
+
+#define LOG_TAG "PatternMatcher"
+#define LOGI(...) __android_log_print(ANDROID_LOG_INFO, LOG_TAG, __VA_ARGS__)
+#define LOGE(...) __android_log_print(ANDROID_LOG_ERROR, LOG_TAG, __VA_ARGS__)
+
+PatternMatcher::PatternMatcher() : m_maxPatternLength(0) {
+    compile();
+}
+
+PatternMatcher::~PatternMatcher() = default;
+
+int PatternMatcher::addPattern(const std::vector<uint8_t>& pattern) {
+    m_patterns.push_back(pattern);
+    m_patternLengths.push_back(pattern.size());
+    m_maxPatternLength = std::max(m_maxPatternLength, pattern.size());
+    return (int)m_patterns.size() - 1;
+}
+
+void PatternMatcher::clear() {
+    m_patterns.clear();
+    m_patternLengths.clear();
+    m_maxPatternLength = 0;
+    compile();
+}
+
+void PatternMatcher::compile() {
+    // Build the trie
+    std::vector<TrieNode> nodes(1);
+    std::fill(std::begin(nodes[0].next), std::end(nodes[0].next), -1);
+    nodes[0].fail = 0;
+
+    for (size_t id = 0; id < m_patterns.size(); ++id) {
+        const auto& pattern = m_patterns[id];
+        if (pattern.empty()) {
+            continue;
+        }
+
+        int current = 0;
+        for (uint8_t byte : pattern) {
+            if (nodes[current].next[byte] < 0) {
+                nodes[current].next[byte] = (int)nodes.size();
+                nodes.emplace_back();
+                std::fill(std::begin(nodes.back().next), std::end(nodes.back().next), -1);
+                nodes.back().fail = 0;
+            }
+            current = nodes[current].next[byte];
+        }
+        nodes[current].outputs.push_back((int)id);
+    }
+
+    // Breadth-first pass: resolve failure links and turn the trie into a complete DFA
+    std::queue<int> pending;
+    for (int byte = 0; byte < 256; ++byte) {
+        int child = nodes[0].next[byte];
+        if (child < 0) {
+            nodes[0].next[byte] = 0;
+        } else {
+            nodes[child].fail = 0;
+            pending.push(child);
+        }
+    }
+
+    while (!pending.empty()) {
+        int state = pending.front();
+        pending.pop();
+
+        const auto& inherited = nodes[nodes[state].fail].outputs;
+        nodes[state].outputs.insert(nodes[state].outputs.end(), inherited.begin(), inherited.end());
+
+        for (int byte = 0; byte < 256; ++byte) {
+            int child = nodes[state].next[byte];
+            if (child < 0) {
+                nodes[state].next[byte] = nodes[nodes[state].fail].next[byte];
+            } else {
+                nodes[child].fail = nodes[nodes[state].fail].next[byte];
+                pending.push(child);
+            }
+        }
+    }
+
+    // Flatten into the scan tables
+    m_transitions.assign(nodes.size() * 256, 0);
+    m_hasOutput.assign(nodes.size(), 0);
+    m_outputOffsets.assign(nodes.size() + 1, 0);
+    m_outputs.clear();
+
+    for (size_t state = 0; state < nodes.size(); ++state) {
+        for (int byte = 0; byte < 256; ++byte) {
+            m_transitions[(state << 8) | byte] = (uint32_t)nodes[state].next[byte];
+        }
+        m_outputOffsets[state] = (uint32_t)m_outputs.size();
+        m_hasOutput[state] = nodes[state].outputs.empty() ? 0 : 1;
+        m_outputs.insert(m_outputs.end(), nodes[state].outputs.begin(), nodes[state].outputs.end());
+    }
+    m_outputOffsets[nodes.size()] = (uint32_t)m_outputs.size();
+
+    buildFirstBytes();
+
+    if (!m_patterns.empty()) {
+        LOGI("Compiled %zu patterns into %zu states", m_patterns.size(), nodes.size());
+    }
+}
+
+void PatternMatcher::buildFirstBytes() {
+    m_firstBytes.clear();
+    for (int byte = 0; byte < 256; ++byte) {
+        if (m_transitions[byte] != 0) {
+            m_firstBytes.add((uint8_t)byte);
+        }
+    }
+}
+
+namespace {
+
+constexpr char kCompiledMagic[8] = {'D', 'R', 'P', 'M', 'A', 'T', 'C', '1'};
+
+template <typename T>
+void writeArray(std::ofstream& file, const std::vector<T>& values) {
+    uint64_t count = values.size();
+    file.write(reinterpret_cast<const char*>(&count), sizeof(count));
+    file.write(reinterpret_cast<const char*>(values.data()), (std::streamsize)(count * sizeof(T)));
+}
+
+template <typename T>
+bool readArray(std::ifstream& file, std::vector<T>& values, uint64_t maxCount) {
+    uint64_t count = 0;
+    if (!file.read(reinterpret_cast<char*>(&count), sizeof(count)) || count > maxCount) {
+        return false;
+    }
+    values.resize(count);
+    return (bool)file.read(reinterpret_cast<char*>(values.data()), (std::streamsize)(count * sizeof(T)));
+}
+
+} // namespace
+
+bool PatternMatcher::saveCompiled(const std::string& path) const {
+    // Written beside the target and renamed over it, so readers never see a partial file
+    const std::string temporary = path + ".tmp";
+    {
+        std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+        if (!file.is_open()) {
+            return false;
+        }
+        file.write(kCompiledMagic, sizeof(kCompiledMagic));
+        writeArray(file, m_patternLengths);
+        for (const auto& pattern : m_patterns) {
+            file.write(reinterpret_cast<const char*>(pattern.data()), (std::streamsize)pattern.size());
+        }
+        writeArray(file, m_transitions);
+        writeArray(file, m_hasOutput);
+        writeArray(file, m_outputOffsets);
+        writeArray(file, m_outputs);
+        if (!file.good()) {
+            file.close();
+            unlink(temporary.c_str());
+            return false;
+        }
+    }
+    if (rename(temporary.c_str(), path.c_str()) != 0) {
+        unlink(temporary.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool PatternMatcher::loadCompiled(const std::string& path) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file.is_open()) {
+        return false;
+    }
+
+    char magic[sizeof(kCompiledMagic)];
+    if (!file.read(magic, sizeof(magic)) || memcmp(magic, kCompiledMagic, sizeof(magic)) != 0) {
+        return false;
+    }
+
+    // The stored patterns must be the ones this matcher was given
+    std::vector<size_t> lengths;
+    if (!readArray(file, lengths, m_patterns.size()) || lengths != m_patternLengths) {
+        return false;
+    }
+    std::vector<uint8_t> stored;
+    for (const auto& pattern : m_patterns) {
+        stored.resize(pattern.size());
+        if (!file.read(reinterpret_cast<char*>(stored.data()), (std::streamsize)stored.size()) ||
+            stored != pattern) {
+            return false;
+        }
+    }
+
+    // A trie never has more states than pattern bytes plus the root
+    uint64_t maxStates = 1;
+    for (size_t length : m_patternLengths) {
+        maxStates += length;
+    }
+    std::vector<uint32_t> transitions;
+    std::vector<uint8_t> hasOutput;
+    std::vector<uint32_t> outputOffsets;
+    std::vector<int> outputs;
+    if (!readArray(file, transitions, maxStates * 256) || !readArray(file, hasOutput, maxStates) ||
+        !readArray(file, outputOffsets, maxStates + 1) || !readArray(file, outputs, maxStates * m_patterns.size())) {
+        return false;
+    }
+
+    // Check every index the scan loop follows without bounds checks
+    const size_t stateCount = hasOutput.size();
+    if (stateCount == 0 || transitions.size() != stateCount * 256 || outputOffsets.size() != stateCount + 1 ||
+        outputOffsets[stateCount] != outputs.size()) {
+        return false;
+    }
+    for (uint32_t next : transitions) {
+        if (next >= stateCount) {
+            return false;
+        }
+    }
+    for (size_t state = 0; state < stateCount; ++state) {
+        if (outputOffsets[state] > outputOffsets[state + 1]) {
+            return false;
+        }
+    }
+    for (int id : outputs) {
+        if (id < 0 || (size_t)id >= m_patterns.size()) {
+            return false;
+        }
+    }
+
+    m_transitions.swap(transitions);
+    m_hasOutput.swap(hasOutput);
+    m_outputOffsets.swap(outputOffsets);
+    m_outputs.swap(outputs);
+    buildFirstBytes();
+    return true;
+}
@@ -0,0 +1,87 @@
+#ifndef PATTERN_MATCHER_H
+#define PATTERN_MATCHER_H
+
+#include "../utils/simd_scan.h"
+#include <string>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+// Aho-Corasick automaton matching many byte patterns in one pass over the data.
+// The automaton is compiled into a dense DFA so scanning costs one table lookup per byte,
+// independent of how many patterns were added. The scan state can be carried from one
+// buffer to the next, so matches spanning buffer edges need no overlap handling.
+// While the automaton sits in its root state, a SIMD prefilter skips straight to the
+// next byte that can begin a pattern.
+class PatternMatcher {
+public:
+    PatternMatcher();
+    ~PatternMatcher();
+
+    // Returns the id reported for this pattern on a match
+    int addPattern(const std::vector<uint8_t>& pattern);
+    void compile();
+    void clear();
+
+    // The compiled tables can be saved and restored to skip compile() on later runs.
+    // loadCompiled() succeeds only if the file holds an automaton for exactly the patterns
+    // added so far, so a stale or damaged file just means compiling again.
+    bool saveCompiled(const std::string& path) const;
+    bool loadCompiled(const std::string& path);
+
+    bool empty() const { return m_patternLengths.empty(); }
+    size_t patternCount() const { return m_patternLengths.size(); }
+    size_t patternLength(int id) const { return m_patternLengths[id]; }
+    size_t maxPatternLength() const { return m_maxPatternLength; }
+    static constexpr uint32_t initialState() { return 0; }
+    // Bytes that can begin a pattern; the prefilter skips everything else
+    const ByteSet& firstBytes() const { return m_firstBytes; }
+
+    // Calls onMatch(patternId, startOffset) for every occurrence ending in [data, data + length).
+    // baseOffset is the absolute offset of data[0]; state is updated for the next call.
+    template <typename Callback>
+    void scan(const uint8_t* data, size_t length, uint64_t baseOffset, uint32_t& state, Callback&& onMatch) const {
+        const uint32_t* transitions = m_transitions.data();
+        const uint8_t* hasOutput = m_hasOutput.data();
+        uint32_t s = state;
+
+        for (size_t i = 0; i < length; ++i) {
+            if (s == 0) {
+                i += m_firstBytes.findFirst(data + i, length - i);
+                if (i >= length) {
+                    break;
+                }
+            }
+            s = transitions[(s << 8) | data[i]];
+            if (hasOutput[s]) {
+                for (uint32_t k = m_outputOffsets[s]; k < m_outputOffsets[s + 1]; ++k) {
+                    int id = m_outputs[k];
+                    onMatch(id, baseOffset + i + 1 - m_patternLengths[id]);
+                }
+            }
+        }
+
+        state = s;
+    }
+
+private:
+    struct TrieNode {
+        int next[256];
+        int fail;
+        std::vector<int> outputs;
+    };
+
+    std::vector<std::vector<uint8_t>> m_patterns;
+    std::vector<size_t> m_patternLengths;
+    size_t m_maxPatternLength;
+
+    std::vector<uint32_t> m_transitions;   // stateCount * 256
+    std::vector<uint8_t> m_hasOutput;      // per state
+    std::vector<uint32_t> m_outputOffsets; // stateCount + 1
+    std::vector<int> m_outputs;
+    ByteSet m_firstBytes;                  // bytes that leave the root state
+
+    void buildFirstBytes();
+};
+
+#endif // PATTERN_MATCHER_H
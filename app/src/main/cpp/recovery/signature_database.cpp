@@ -0,0 +1,309 @@
+#include "signature_database.h"
+#include <android/log.h>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
+#define LOG_TAG "SignatureDatabase"
+#define LOGI(...) __android_log_print(ANDROID_LOG_INFO, LOG_TAG, __VA_ARGS__)
+#define LOGE(...) __android_log_print(ANDROID_LOG_ERROR, LOG_TAG, __VA_ARGS__)
+
+namespace {
+
+// Built-in records. Container subtypes (APK in ZIP, AVI / WAVE / WebP in RIFF, HEIF / AVIF
+// in ISO BMFF) come before the bare container so they win when both match.
+const char kBuiltinDatabase[] = R"(
+jpeg  type=1 ext=jpg  max=50M  header=ffd8ff footer=ffd9 walker=jpeg
+png   type=1 ext=png  max=20M  header=89504e470d0a1a0a footer=49454e44ae426082 walker=png
+gif   type=1 ext=gif  max=20M  header=47494638
+webp  type=1 ext=webp max=20M  header=52494646????????57454250
+heic  type=1 ext=heic max=50M  offset=4 header=6674797068656963 walker=mp4
+avif  type=1 ext=avif max=50M  offset=4 header=6674797061766966 walker=mp4
+mp4   type=2 ext=mp4  max=500M header=000000??66747970 walker=mp4
+avi   type=2 ext=avi  max=500M header=52494646????????41564920
+mkv   type=2 ext=mkv  max=500M header=1a45dfa3
+pdf   type=3 ext=pdf  max=50M  header=25504446 footer=2525454f46 walker=pdf
+mp3   type=4 ext=mp3  max=100M header=fffb
+wav   type=4 ext=wav  max=100M header=52494646????????57415645
+ogg   type=4 ext=ogg  max=100M header=4f67675300
+flac  type=4 ext=flac max=100M header=664c6143
+amr   type=4 ext=amr  max=20M  header=2321414d520a
+rar   type=5 ext=rar  max=500M header=526172211a07
+7z    type=5 ext=7z   max=500M header=377abcaf271c
+gzip  type=5 ext=gz   max=500M header=1f8b08
+apk   type=6 ext=apk  max=200M header=504b0304????????????????????????????????????????????????????416e64726f69644d616e69 footer=504b0506 trailer=18
+apk   type=6 ext=apk  max=200M header=504b0304????????????????????????????????????????????????????636c61737365732e646578 footer=504b0506 trailer=18
+zip   type=5 ext=zip  max=500M header=504b0304 footer=504b0506 trailer=18
+)";
+
+int hexValue(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+// Parses hex bytes; "??" is a wildcard byte and yields a 0x00 mask byte when allowed
+bool parseHex(const std::string& text, std::vector<uint8_t>& bytes, std::vector<uint8_t>* mask) {
+    if (text.empty() || text.size() % 2 != 0) {
+        return false;
+    }
+    bytes.clear();
+    if (mask) {
+        mask->clear();
+    }
+    for (size_t i = 0; i < text.size(); i += 2) {
+        if (text[i] == '?' && text[i + 1] == '?') {
+            if (!mask) {
+                return false;
+            }
+            bytes.push_back(0);
+            mask->push_back(0x00);
+            continue;
+        }
+        int high = hexValue(text[i]);
+        int low = hexValue(text[i + 1]);
+        if (high < 0 || low < 0) {
+            return false;
+        }
+        bytes.push_back((uint8_t)((high << 4) | low));
+        if (mask) {
+            mask->push_back(0xFF);
+        }
+    }
+    return true;
+}
+
+bool parseNumber(const std::string& text, uint64_t& value) {
+    if (text.empty()) {
+        return false;
+    }
+    char* end = nullptr;
+    unsigned long long number = strtoull(text.c_str(), &end, 10);
+    if (end == text.c_str()) {
+        return false;
+    }
+    uint64_t scale = 1;
+    if (*end == 'K' || *end == 'k') {
+        scale = 1024;
+        ++end;
+    } else if (*end == 'M' || *end == 'm') {
+        scale = 1024 * 1024;
+        ++end;
+    } else if (*end == 'G' || *end == 'g') {
+        scale = 1024ULL * 1024 * 1024;
+        ++end;
+    }
+    if (*end != '\0') {
+        return false;
+    }
+    value = (uint64_t)number * scale;
+    return true;
+}
+
+} // namespace
+
+SignatureDatabase::SignatureDatabase() : m_headerSpan(0) {}
+
+SignatureDatabase::~SignatureDatabase() = default;
+
+bool SignatureDatabase::parseRecord(const std::string& line, SignatureRecord& record, std::string& error) {
+    std::istringstream fields(line);
+    record = SignatureRecord();
+    record.fileType = -1;
+    fields >> record.name;
+
+    std::vector<uint8_t> explicitMask;
+    std::string field;
+    while (fields >> field) {
+        size_t equals = field.find('=');
+        if (equals == std::string::npos) {
+            error = "expected key=value, got '" + field + "'";
+            return false;
+        }
+        std::string key = field.substr(0, equals);
+        std::string value = field.substr(equals + 1);
+        uint64_t number = 0;
+
+        bool valid = true;
+        if (key == "type") {
+            valid = parseNumber(value, number) && number <= 6;
+            record.fileType = (int)number;
+        } else if (key == "ext") {
+            valid = !value.empty();
+            record.extension = value;
+        } else if (key == "max") {
+            valid = parseNumber(value, number) && number > 0;
+            record.maxSize = number;
+        } else if (key == "header") {
+            valid = parseHex(value, record.header, &record.headerMask);
+        } else if (key == "mask") {
+            valid = parseHex(value, explicitMask, nullptr);
+        } else if (key == "offset") {
+            valid = parseNumber(value, number) && number < kMaxHeaderSpan;
+            record.headerOffset = (uint32_t)number;
+        } else if (key == "footer") {
+            valid = parseHex(value, record.footer, nullptr);
+        } else if (key == "trailer") {
+            valid = parseNumber(value, number) && number < kMaxHeaderSpan;
+            record.trailerLength = (uint32_t)number;
+        } else if (key == "walker") {
+            record.walker = value;
+        } else {
+            error = "unknown key '" + key + "'";
+            return false;
+        }
+        if (!valid) {
+            error = "bad value for '" + key + "'";
+            return false;
+        }
+    }
+
+    if (record.fileType < 0 || record.extension.empty() || record.maxSize == 0 || record.header.empty()) {
+        error = "type, ext, max and header are required";
+        return false;
+    }
+    if (record.header.size() > kMaxHeaderLength ||
+        record.headerOffset + record.header.size() > kMaxHeaderSpan) {
+        error = "header too long or too far into the file";
+        return false;
+    }
+    if (!explicitMask.empty()) {
+        if (explicitMask.size() != record.header.size()) {
+            error = "mask and header lengths differ";
+            return false;
+        }
+        for (size_t i = 0; i < explicitMask.size(); ++i) {
+            record.headerMask[i] &= explicitMask[i];
+            record.header[i] &= explicitMask[i];
+        }
+    }
+
+    // Anchor on the longest fully significant run, the earliest one on ties
+    for (size_t i = 0; i < record.header.size();) {
+        if (record.headerMask[i] != 0xFF) {
+            ++i;
+            continue;
+        }
+        size_t run = i;
+        while (run < record.header.size() && record.headerMask[run] == 0xFF) {
+            ++run;
+        }
+        if (run - i > record.anchorLength) {
+            record.anchorOffset = (uint32_t)i;
+            record.anchorLength = (uint32_t)(run - i);
+        }
+        i = run;
+    }
+    // Shorter anchors would match almost everywhere
+    if (record.anchorLength < 2) {
+        error = "header needs at least two consecutive fixed bytes";
+        return false;
+    }
+    return true;
+}
+
+bool SignatureDatabase::parse(const std::string& text) {
+    std::vector<SignatureRecord> records;
+    std::istringstream lines(text);
+    std::string line;
+    int lineNumber = 0;
+
+    while (std::getline(lines, line)) {
+        ++lineNumber;
+        size_t comment = line.find('#');
+        if (comment != std::string::npos) {
+            line.erase(comment);
+        }
+        if (line.find_first_not_of(" \t\r") == std::string::npos) {
+            continue;
+        }
+
+        SignatureRecord record;
+        std::string error;
+        if (!parseRecord(line, record, error)) {
+            LOGE("Signature database line %d: %s", lineNumber, error.c_str());
+            return false;
+        }
+        records.push_back(record);
+    }
+
+    if (records.empty()) {
+        LOGE("Signature database has no records");
+        return false;
+    }
+
+    m_records.swap(records);
+    m_roles.clear();
+    m_matcher.clear();
+    m_headerSpan = 0;
+    return true;
+}
+
+bool SignatureDatabase::parseFile(const std::string& path) {
+    std::ifstream file(path);
+    if (!file.is_open()) {
+        LOGE("Cannot open signature database %s", path.c_str());
+        return false;
+    }
+    std::stringstream text;
+    text << file.rdbuf();
+    return parse(text.str());
+}
+
+void SignatureDatabase::compile(const std::string& cacheDir) {
+    m_matcher.clear();
+    m_roles.clear();
+    m_headerSpan = 0;
+
+    for (size_t i = 0; i < m_records.size(); ++i) {
+        const SignatureRecord& record = m_records[i];
+        const auto anchor = record.header.begin() + record.anchorOffset;
+        m_matcher.addPattern(std::vector<uint8_t>(anchor, anchor + record.anchorLength));
+        m_roles.push_back({(uint32_t)i, false});
+        if (!record.footer.empty()) {
+            m_matcher.addPattern(record.footer);
+            m_roles.push_back({(uint32_t)i, true});
+        }
+        m_headerSpan = std::max(m_headerSpan, record.headerOffset + record.header.size());
+    }
+
+    if (cacheDir.empty()) {
+        m_matcher.compile();
+        return;
+    }
+
+    const std::string cachePath = cacheDir + "/signature_matcher.bin";
+    if (m_matcher.loadCompiled(cachePath)) {
+        LOGI("Loaded compiled signatures from %s", cachePath.c_str());
+        return;
+    }
+    m_matcher.compile();
+    if (!m_matcher.saveCompiled(cachePath)) {
+        LOGE("Cannot cache compiled signatures in %s", cacheDir.c_str());
+    }
+}
+
+std::shared_ptr<const SignatureDatabase> SignatureDatabase::builtin() {
+    static const std::shared_ptr<const SignatureDatabase> database = [] {
+        auto builtinDatabase = std::make_shared<SignatureDatabase>();
+        builtinDatabase->parse(kBuiltinDatabase);
+        builtinDatabase->compile();
+        return builtinDatabase;
+    }();
+    return database;
+}
+
+bool SignatureDatabase::matchesHeader(const SignatureRecord& record, const uint8_t* header, size_t available) {
+    if (available < record.header.size()) {
+        return false;
+    }
+    for (size_t i = 0; i < record.header.size(); ++i) {
+        if ((header[i] & record.headerMask[i]) != record.header[i]) {
+            return false;
+        }
+    }
+    return true;
+}
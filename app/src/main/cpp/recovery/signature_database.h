@@ -0,0 +1,89 @@
+#ifndef SIGNATURE_DATABASE_H
+#define SIGNATURE_DATABASE_H
+
+#include "pattern_matcher.h"
+#include <string>
+#include <vector>
+#include <memory>
+#include <cstddef>
+#include <cstdint>
+
+// One file format as described by the signature database
+struct SignatureRecord {
+    std::string name;
+    std::string extension;
+    int fileType;
+    std::vector<uint8_t> header;
+    std::vector<uint8_t> headerMask; // per header byte; 0xFF = must match, 0x00 = any value
+    uint32_t headerOffset;           // where the header sits inside the file
+    std::vector<uint8_t> footer;     // empty: the file is bounded by the next header or maxSize
+    uint32_t trailerLength;          // bytes of the file that follow the footer
+    uint64_t maxSize;
+    std::string walker;              // structural walker for carving, empty if none
+
+    // The longest run of fully significant header bytes is what the matcher looks for;
+    // the rest of the header is checked against the mask once the anchor is found
+    uint32_t anchorOffset;
+    uint32_t anchorLength;
+};
+
+// File signatures loaded from a text database and compiled into one Aho-Corasick automaton
+// over every record's header anchor and footer. SignatureDetector and FileCarver share a
+// compiled database, so adding formats adds no per-format scan cost to either.
+//
+// Database format: one record per line, '#' starts a comment. A line is the record name
+// followed by key=value fields:
+//   type=N       file type (1 photo, 2 video, 3 document, 4 audio, 5 archive, 6 APK, 0 other)
+//   ext=E        extension given to carved files
+//   max=N[K|M|G] largest plausible file size
+//   header=HEX   magic bytes; "??" matches any byte
+//   mask=HEX     optional per-byte mask over header, instead of "??"
+//   offset=N     position of header inside the file (default 0)
+//   footer=HEX   optional end marker, with trailer=N bytes of the file after it
+//   walker=W     optional structural walker: jpeg, png, mp4 or pdf
+// Where several records match the same file start, the earlier record wins.
+class SignatureDatabase {
+public:
+    // Maps a matcher pattern id back to its record
+    struct PatternRole {
+        uint32_t record;
+        bool isFooter;
+    };
+
+    SignatureDatabase();
+    ~SignatureDatabase();
+
+    // Replaces the records; on a syntax error nothing is changed and false is returned
+    bool parse(const std::string& text);
+    bool parseFile(const std::string& path);
+
+    // Builds the matcher. With a cache directory the compiled automaton is restored from
+    // there when it was built from the same patterns, and saved there otherwise.
+    void compile(const std::string& cacheDir = "");
+
+    // The database shipped with the library, parsed and compiled on first use
+    static std::shared_ptr<const SignatureDatabase> builtin();
+
+    const std::vector<SignatureRecord>& records() const { return m_records; }
+    const PatternMatcher& matcher() const { return m_matcher; }
+    const PatternRole& role(int patternId) const { return m_roles[patternId]; }
+
+    // Bytes from the start of a file needed to check every header
+    size_t headerSpan() const { return m_headerSpan; }
+
+    // Checks the full masked header; header points at headerOffset into the file
+    static bool matchesHeader(const SignatureRecord& record, const uint8_t* header, size_t available);
+
+    static constexpr size_t kMaxHeaderLength = 64;
+    static constexpr size_t kMaxHeaderSpan = 1024;
+
+private:
+    std::vector<SignatureRecord> m_records;
+    std::vector<PatternRole> m_roles;
+    PatternMatcher m_matcher;
+    size_t m_headerSpan;
+
+    static bool parseRecord(const std::string& line, SignatureRecord& record, std::string& error);
+};
+
+#endif // SIGNATURE_DATABASE_H
@@ -1,133 +1,57 @@
 #include "signature_detector.h"
-#include <android/log.h>
-#include <fstream>
+#include "../utils/extension_classifier.h"
 #include <algorithm>
+#include <cstring>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
 
-#define LOG_TAG "SignatureDetector"
-#define LOGI(...) __android_log_print(ANDROID_LOG_INFO, LOG_TAG, __VA_ARGS__)
-#define LOGE(...) __android_log_print(ANDROID_LOG_ERROR, LOG_TAG, __VA_ARGS__)
-
-SignatureDetector::SignatureDetector() {
-    initializeSignatures();
-}
+SignatureDetector::SignatureDetector() : m_database(SignatureDatabase::builtin()) {}
 
 SignatureDetector::~SignatureDetector() = default;
 
-void SignatureDetector::initializeSignatures() {
-    // JPEG signatures
-    m_signatures.push_back({
-        {0xFF, 0xD8, 0xFF}, // JPEG header
-        1, // PHOTO
-        "jpg"
-    });
-    
-    // PNG signatures
-    m_signatures.push_back({
-        {0x89, 0x50, 0x4E, 0x47, 0x0D, 0x0A, 0x1A, 0x0A}, // PNG header
-        1, // PHOTO
-        "png"
-    });
-    
-    // GIF signatures
-    m_signatures.push_back({
-        {0x47, 0x49, 0x46, 0x38}, // GIF87a or GIF89a
-        1, // PHOTO
-        "gif"
-    });
-    
-    // MP4 signatures
-    m_signatures.push_back({
-        {0x00, 0x00, 0x00, 0x18, 0x66, 0x74, 0x79, 0x70}, // MP4 ftyp box
-        2, // VIDEO
-        "mp4"
-    });
-    
-    // AVI signatures
-    m_signatures.push_back({
-        {0x52, 0x49, 0x46, 0x46}, // RIFF header (AVI)
-        2, // VIDEO
-        "avi"
-    });
-    
-    // MP3 signatures
-    m_signatures.push_back({
-        {0xFF, 0xFB}, // MP3 frame header
-        4, // AUDIO
-        "mp3"
-    });
-    
-    // WAV signatures
-    m_signatures.push_back({
-        {0x52, 0x49, 0x46, 0x46}, // RIFF header (WAV)
-        4, // AUDIO
-        "wav"
-    });
-    
-    // PDF signatures
-    m_signatures.push_back({
-        {0x25, 0x50, 0x44, 0x46}, // %PDF
-        3, // DOCUMENT
-        "pdf"
-    });
-    
-    // ZIP signatures
-    m_signatures.push_back({
-        {0x50, 0x4B, 0x03, 0x04}, // ZIP local file header
-        5, // ARCHIVE
-        "zip"
-    });
-    
-    // APK signatures (same as ZIP)
-    m_signatures.push_back({
-        {0x50, 0x4B, 0x03, 0x04}, // APK is ZIP format
-        6, // APK
-        "apk"
-    });
-    
-    LOGI("Initialized %zu file signatures", m_signatures.size());
+void SignatureDetector::setDatabase(std::shared_ptr<const SignatureDatabase> database) {
+    m_database = std::move(database);
 }
 
 int SignatureDetector::detectFileType(const std::string& filePath) {
-    std::ifstream file(filePath, std::ios::binary);
-    if (!file.is_open()) {
+    uint8_t buffer[SignatureDatabase::kMaxHeaderSpan];
+    return detectAt(AT_FDCWD, filePath.c_str(), buffer);
+}
+
+void SignatureDetector::detectFileTypes(int dirFd, const std::vector<std::string>& names,
+                                        std::vector<int>& types) {
+    uint8_t buffer[SignatureDatabase::kMaxHeaderSpan];
+    types.resize(names.size());
+    for (size_t i = 0; i < names.size(); ++i) {
+        types[i] = detectAt(dirFd, names[i].c_str(), buffer);
+    }
+}
+
+int SignatureDetector::detectAt(int dirFd, const char* name, uint8_t* buffer) {
+    int fd = openat(dirFd, name, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
         return 0; // OTHER
     }
     
-    // Read first 16 bytes for signature detection
-    uint8_t buffer[16];
-    file.read(reinterpret_cast<char*>(buffer), sizeof(buffer));
-    size_t bytesRead = file.gcount();
-    file.close();
+    // Read the leading bytes for signature detection
+    ssize_t bytesRead;
+    do {
+        bytesRead = pread(fd, buffer, m_database->headerSpan(), 0);
+    } while (bytesRead < 0 && errno == EINTR);
+    close(fd);
     
-    if (bytesRead == 0) {
+    if (bytesRead <= 0) {
         return 0; // OTHER
     }
     
-    // Check against known signatures
-    for (const auto& signature : m_signatures) {
-        if (bytesRead >= signature.pattern.size()) {
-            if (matchesPattern(buffer, signature.pattern)) {
-                // Additional validation for some formats
-                if (signature.extension == "wav" || signature.extension == "avi") {
-                    // Check for specific format indicators
-                    if (bytesRead >= 12) {
-                        if (signature.extension == "wav" && 
-                            buffer[8] == 'W' && buffer[9] == 'A' && buffer[10] == 'V' && buffer[11] == 'E') {
-                            return signature.fileType;
-                        } else if (signature.extension == "avi" && 
-                                   buffer[8] == 'A' && buffer[9] == 'V' && buffer[10] == 'I' && buffer[11] == ' ') {
-                            return signature.fileType;
-                        }
-                    }
-                } else {
-                    return signature.fileType;
-                }
-            }
-        }
+    int fileType = detectFileType(buffer, static_cast<size_t>(bytesRead));
+    if (fileType != 0) {
+        return fileType;
     }
     
     // Fallback to extension-based detection
-    return detectByExtension(filePath);
+    return detectByExtension(name);
 }
 
 int SignatureDetector::detectFileType(const uint8_t* data, size_t size) {
@@ -135,89 +59,34 @@ int SignatureDetector::detectFileType(const uint8_t* data, size_t size) {
         return 0; // OTHER
     }
     
-    // Check against known signatures
-    for (const auto& signature : m_signatures) {
-        if (size >= signature.pattern.size()) {
-            if (matchesPattern(data, signature.pattern)) {
-                // Additional validation for some formats
-                if (signature.extension == "wav" || signature.extension == "avi") {
-                    if (size >= 12) {
-                        if (signature.extension == "wav" && 
-                            data[8] == 'W' && data[9] == 'A' && data[10] == 'V' && data[11] == 'E') {
-                            return signature.fileType;
-                        } else if (signature.extension == "avi" && 
-                                   data[8] == 'A' && data[9] == 'V' && data[10] == 'I' && data[11] == ' ') {
-                            return signature.fileType;
-                        }
-                    }
-                } else {
-                    return signature.fileType;
-                }
-            }
+    // Every header anchor found at its place in the file is a candidate; the earliest
+    // record whose full masked header matches wins
+    const SignatureDatabase& database = *m_database;
+    const auto& records = database.records();
+    size_t best = records.size();
+    uint32_t state = PatternMatcher::initialState();
+    database.matcher().scan(data, std::min(size, database.headerSpan()), 0, state,
+                            [&](int patternId, uint64_t position) {
+        const SignatureDatabase::PatternRole& role = database.role(patternId);
+        const SignatureRecord& record = records[role.record];
+        if (role.isFooter || role.record >= best ||
+            position != (uint64_t)record.headerOffset + record.anchorOffset) {
+            return;
         }
-    }
-    
-    return 0; // OTHER
-}
-
-bool SignatureDetector::matchesPattern(const uint8_t* data, const std::vector<uint8_t>& pattern) {
-    for (size_t i = 0; i < pattern.size(); ++i) {
-        if (data[i] != pattern[i]) {
-            return false;
+        if (SignatureDatabase::matchesHeader(record, data + record.headerOffset, size - record.headerOffset)) {
+            best = role.record;
         }
-    }
-    return true;
+    });
+    
+    return best < records.size() ? records[best].fileType : 0; // 0: OTHER
 }
 
-int SignatureDetector::detectByExtension(const std::string& filePath) {
-    size_t dotPos = filePath.find_last_of('.');
-    if (dotPos == std::string::npos) {
+int SignatureDetector::detectByExtension(const char* filePath) {
+    const char* dot = strrchr(filePath, '.');
+    if (!dot) {
         return 0; // OTHER
     }
-    
-    std::string extension = filePath.substr(dotPos + 1);
-    std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
-    
-    // Photo extensions
-    if (extension == "jpg" || extension == "jpeg" || extension == "png" || 
-        extension == "gif" || extension == "bmp" || extension == "webp" || 
-        extension == "heic" || extension == "tiff") {
-        return 1; // PHOTO
-    }
-    
-    // Video extensions
-    if (extension == "mp4" || extension == "avi" || extension == "mov" || 
-        extension == "mkv" || extension == "3gp" || extension == "flv" || 
-        extension == "wmv" || extension == "webm") {
-        return 2; // VIDEO
-    }
-    
-    // Document extensions
-    if (extension == "pdf" || extension == "doc" || extension == "docx" || 
-        extension == "xls" || extension == "xlsx" || extension == "ppt" || 
-        extension == "pptx" || extension == "txt" || extension == "rtf") {
-        return 3; // DOCUMENT
-    }
-    
-    // Audio extensions
-    if (extension == "mp3" || extension == "wav" || extension == "aac" || 
-        extension == "flac" || extension == "ogg" || extension == "m4a" || 
-        extension == "wma") {
-        return 4; // AUDIO
-    }
-    
-    // Archive extensions
-    if (extension == "zip" || extension == "rar" || extension == "7z" || 
-        extension == "tar" || extension == "gz" || extension == "bz2") {
-        return 5; // ARCHIVE
-    }
-    
-    // APK extension
-    if (extension == "apk") {
-        return 6; // APK
-    }
-    
-    return 0; // OTHER
+    return ExtensionClassifier::classify(dot + 1, strlen(dot + 1));
 }
 
 std::string SignatureDetector::getFileExtension(int fileType) {
@@ -1,32 +1,38 @@
 #ifndef SIGNATURE_DETECTOR_H
 #define SIGNATURE_DETECTOR_H
 
+#include "signature_database.h"
 #include <string>
 #include <vector>
+#include <memory>
+#include <cstddef>
 #include <cstdint>
 
+// Identifies files by their leading magic bytes, using the compiled automaton of a shared
+// SignatureDatabase, so a lookup is one pass over the header whatever the number of formats.
+// detectFileType(data, size) wants the database's headerSpan() bytes where available.
 class SignatureDetector {
 public:
     SignatureDetector();
     ~SignatureDetector();
 
+    // Defaults to the built-in database
+    void setDatabase(std::shared_ptr<const SignatureDatabase> database);
+
     int detectFileType(const std::string& filePath);
     int detectFileType(const uint8_t* data, size_t size);
+    // Detects many files with one header buffer and no per-file stream setup. Names are
+    // resolved against dirFd as by openat(), so a directory walker can pass the fd of the
+    // directory it is reading; pass AT_FDCWD for plain paths. types is resized to match.
+    void detectFileTypes(int dirFd, const std::vector<std::string>& names, std::vector<int>& types);
     std::string getFileExtension(int fileType);
     bool isValidFileSignature(const uint8_t* data, size_t size, int expectedType);
 
 private:
-    struct FileSignature {
-        std::vector<uint8_t> pattern;
-        int fileType;
-        std::string extension;
-    };
-    
-    std::vector<FileSignature> m_signatures;
-    
-    void initializeSignatures();
-    bool matchesPattern(const uint8_t* data, const std::vector<uint8_t>& pattern);
-    int detectByExtension(const std::string& filePath);
+    std::shared_ptr<const SignatureDatabase> m_database;
+
+    int detectAt(int dirFd, const char* name, uint8_t* buffer);
+    int detectByExtension(const char* filePath);
 };
 
-#endif // SIGNATURE_DETECTOR_H
\ No newline at end of file
+#endif // SIGNATURE_DETECTOR_H
@@ -0,0 +1,178 @@
+// Builds small ext4 images with mkfs.ext4, deletes files with debugfs, and checks the
+// scanner's superblock, group descriptors and deleted inodes against dumpe2fs and debugfs
+#include "test_support.h"
+#include "../filesystem/ext4_scanner.h"
+
+#include <map>
+#include <regex>
+#include <sstream>
+
+class Ext4ScannerTest {
+public:
+    static void checkGeometry(const std::string& image);
+    static void checkDeletedFiles(const std::string& image, const std::map<std::string, std::vector<uint8_t>>& files);
+};
+
+// "Label:   value" lines from the header dumpe2fs prints before the groups
+static std::map<std::string, std::string> parseHeader(const std::string& output) {
+    std::map<std::string, std::string> fields;
+    std::istringstream lines(output);
+    std::string line;
+    while (std::getline(lines, line) && !line.empty()) {
+        const size_t colon = line.find(':');
+        if (colon == std::string::npos) {
+            continue;
+        }
+        const size_t value = line.find_first_not_of(' ', colon + 1);
+        fields[line.substr(0, colon)] = value == std::string::npos ? "" : line.substr(value);
+    }
+    return fields;
+}
+
+static uint64_t headerNumber(const std::map<std::string, std::string>& fields, const std::string& name) {
+    auto found = fields.find(name);
+    return found == fields.end() ? ~0ull : std::stoull(found->second);
+}
+
+void Ext4ScannerTest::checkGeometry(const std::string& image) {
+    std::string output;
+    CHECK(runCommand("dumpe2fs '" + image + "' 2>/dev/null", output));
+
+    Ext4Scanner scanner;
+    CHECK(scanner.initialize(true));
+    CHECK(scanner.readSuperblock(image));
+    CHECK(scanner.readGroupDescriptors());
+
+    const auto header = parseHeader(output);
+    CHECK_EQ(scanner.m_blockSize, headerNumber(header, "Block size"));
+    CHECK_EQ(scanner.m_blocksCount, headerNumber(header, "Block count"));
+    CHECK_EQ(scanner.m_blocksPerGroup, headerNumber(header, "Blocks per group"));
+    CHECK_EQ(scanner.m_firstDataBlock, headerNumber(header, "First block"));
+    CHECK_EQ(scanner.m_inodesCount, headerNumber(header, "Inode count"));
+    CHECK_EQ(scanner.m_inodesPerGroup, headerNumber(header, "Inodes per group"));
+    CHECK_EQ(scanner.m_inodeSize, headerNumber(header, "Inode size"));
+
+    // Per group: "Block bitmap at N", "Inode bitmap at N", "Inode table at N-M" and
+    // "... free blocks, N free inodes"
+    static const std::regex kGroup("^Group ([0-9]+):");
+    static const std::regex kBlockBitmap("Block bitmap at ([0-9]+)");
+    static const std::regex kInodeBitmap("Inode bitmap at ([0-9]+)");
+    static const std::regex kInodeTable("Inode table at ([0-9]+)");
+    static const std::regex kFreeInodes("([0-9]+) free inodes");
+    std::istringstream lines(output);
+    std::string line;
+    std::smatch match;
+    size_t group = 0;
+    size_t groups = 0;
+    while (std::getline(lines, line)) {
+        if (std::regex_search(line, match, kGroup)) {
+            group = std::stoul(match[1]);
+            ++groups;
+            CHECK(group < scanner.m_groups.size());
+            continue;
+        }
+        if (groups == 0 || group >= scanner.m_groups.size()) {
+            continue;
+        }
+        const auto& descriptor = scanner.m_groups[group];
+        if (std::regex_search(line, match, kBlockBitmap)) {
+            CHECK_EQ(descriptor.blockBitmap, std::stoull(match[1]));
+        } else if (std::regex_search(line, match, kInodeBitmap)) {
+            CHECK_EQ(descriptor.inodeBitmap, std::stoull(match[1]));
+        } else if (std::regex_search(line, match, kInodeTable)) {
+            CHECK_EQ(descriptor.inodeTable, std::stoull(match[1]));
+        } else if (std::regex_search(line, match, kFreeInodes)) {
+            CHECK_EQ(descriptor.freeInodes, std::stoull(match[1]));
+        }
+    }
+    CHECK(groups > 0);
+    CHECK_EQ(scanner.m_groups.size(), groups);
+}
+
+void Ext4ScannerTest::checkDeletedFiles(const std::string& image,
+                                        const std::map<std::string, std::vector<uint8_t>>& files) {
+    // "13  0 100644  70000  18/ 18 <time>" rows, one per deleted inode with blocks
+    std::string output;
+    CHECK(runCommand("debugfs -R lsdel '" + image + "' 2>/dev/null", output));
+    static const std::regex kRow("^ *([0-9]+) +[0-9]+ +[0-7]+ +([0-9]+) ");
+    std::map<uint64_t, size_t> expectedSizes; // size -> count
+    std::istringstream lines(output);
+    std::string line;
+    std::smatch match;
+    while (std::getline(lines, line)) {
+        if (std::regex_search(line, match, kRow)) {
+            ++expectedSizes[std::stoull(match[2])];
+        }
+    }
+    CHECK_EQ(expectedSizes.size(), files.size());
+
+    Ext4Scanner scanner;
+    CHECK(scanner.initialize(true));
+    const auto results = scanner.scanDeletedFiles(image, {}, nullptr);
+    std::map<uint64_t, size_t> foundSizes;
+    for (const auto& result : results) {
+        ++foundSizes[(uint64_t)result.size];
+    }
+    CHECK(foundSizes == expectedSizes);
+
+    // Every deleted file comes back under its old path with its old content
+    BlockDevice device;
+    CHECK(device.open(image));
+    for (const auto& file : files) {
+        const RecoveredFileInfo* found = nullptr;
+        for (const auto& result : results) {
+            if (result.path == "/data/" + file.first) {
+                found = &result;
+            }
+        }
+        CHECK(found != nullptr);
+        if (!found) {
+            std::fprintf(stderr, "no deleted file recovered as %s\n", file.first.c_str());
+            continue;
+        }
+        std::vector<uint8_t> content;
+        for (const auto& extent : found->extents) {
+            std::vector<uint8_t> bytes((size_t)extent.length);
+            CHECK_EQ(device.read((uint64_t)extent.offset, bytes.data(), bytes.size()), (long long)bytes.size());
+            content.insert(content.end(), bytes.begin(), bytes.end());
+        }
+        CHECK(content == file.second);
+    }
+}
+
+int main() {
+    if (!haveTool("mkfs.ext4") || !haveTool("debugfs") || !haveTool("dumpe2fs")) {
+        std::fprintf(stderr, "e2fsprogs not installed, skipping\n");
+        return kTestSkipped;
+    }
+    TempDirectory directory;
+    CHECK(directory.valid());
+
+    const std::map<std::string, std::vector<uint8_t>> deleted = {
+        {"photo.bin", patternBytes(70000, 1)},
+        {"notes/page.txt", patternBytes(5000, 2)},
+        {"notes/deep/archive.bin", patternBytes(300000, 3)},
+    };
+    const std::string source = directory.file("source");
+    CHECK(runCommand("mkdir -p '" + source + "/notes/deep'"));
+    for (const auto& file : deleted) {
+        CHECK(writeFile(source + "/" + file.first, file.second));
+    }
+    CHECK(writeFile(source + "/kept.bin", patternBytes(20000, 4)));
+
+    // 4 KiB blocks split into several flex groups, and 1 KiB blocks where block 0 is
+    // the boot block
+    const char* const layouts[] = {"-b 4096 -g 2048", "-b 1024"};
+    for (const char* layout : layouts) {
+        const std::string image = directory.file("ext4.img");
+        CHECK(runCommand(std::string("mkfs.ext4 -q -F ") + layout + " -d '" + source + "' '" + image +
+                         "' 32M >/dev/null 2>&1"));
+        for (const auto& file : deleted) {
+            CHECK(runCommand("debugfs -w -R 'rm /" + file.first + "' '" + image + "' >/dev/null 2>&1"));
+        }
+
+        Ext4ScannerTest::checkGeometry(image);
+        Ext4ScannerTest::checkDeletedFiles(image, deleted);
+    }
+    return testResult();
+}
@@ -0,0 +1,477 @@
+// Recovers deleted files from F2FS images laid out here block by block, then formats
+// images with mkfs.f2fs, fills them with sload.f2fs, and checks the scanner's checkpoint,
+// SIT and NAT against what dump.f2fs reads from the same image
+#include "test_support.h"
+#include "../filesystem/f2fs_scanner.h"
+
+#include <cstring>
+#include <map>
+#include <regex>
+#include <sstream>
+#include <zlib.h>
+
+class F2fsScannerTest {
+public:
+    static void checkCheckpoint(F2fsScanner& scanner, const std::string& image);
+    static void checkSit(F2fsScanner& scanner, const std::string& directory);
+    static void checkNat(F2fsScanner& scanner, const std::string& directory);
+    static void checkDeletedFiles(const TempDirectory& directory, bool extraAttributes);
+};
+
+void F2fsScannerTest::checkCheckpoint(F2fsScanner& scanner, const std::string& image) {
+    // At debug level 1 the superblock and checkpoint fields print as "name [0x.. : value]"
+    std::string output;
+    CHECK(runCommand("dump.f2fs -d 1 '" + image + "' 2>&1", output));
+    static const std::regex kField("^\\s*([A-Za-z_]+(\\[[0-9]+\\])?)\\s+\\[0x\\s*[0-9a-fA-F]+\\s*:\\s*([0-9]+)\\]");
+    std::map<std::string, uint64_t> fields;
+    std::istringstream lines(output);
+    std::string line;
+    std::smatch match;
+    while (std::getline(lines, line)) {
+        if (std::regex_search(line, match, kField)) {
+            fields.emplace(match[1], std::stoull(match[3]));
+        }
+    }
+    auto field = [&](const std::string& name) {
+        auto found = fields.find(name);
+        CHECK(found != fields.end());
+        if (found == fields.end()) {
+            std::fprintf(stderr, "dump.f2fs printed no %s\n", name.c_str());
+        }
+        return found == fields.end() ? ~0ull : found->second;
+    };
+
+    CHECK(scanner.readCheckpoint(image));
+    const uint64_t logBlocksPerSegment = field("log_blocks_per_seg");
+    CHECK_EQ(scanner.m_blocksPerSegment, logBlocksPerSegment < 32 ? 1ull << logBlocksPerSegment : 0);
+    CHECK_EQ(scanner.m_segmentCountMain, field("segment_count_main"));
+    CHECK_EQ(scanner.m_checkpointAddress, field("cp_blkaddr"));
+    CHECK_EQ(scanner.m_sitAddress, field("sit_blkaddr"));
+    CHECK_EQ(scanner.m_natAddress, field("nat_blkaddr"));
+    CHECK_EQ(scanner.m_mainAddress, field("main_blkaddr"));
+    CHECK_EQ(scanner.m_rootIno, field("root_ino"));
+    CHECK_EQ(scanner.m_checkpointVersion, field("checkpoint_ver"));
+    CHECK_EQ(scanner.m_checkpointFlags, field("ckpt_flags"));
+    for (int i = 0; i < 3; ++i) {
+        const std::string index = "[" + std::to_string(i) + "]";
+        CHECK_EQ(scanner.m_currentNodeSegments[i], field("cur_node_segno" + index));
+        CHECK_EQ(scanner.m_currentNodeOffsets[i], field("cur_node_blkoff" + index));
+    }
+}
+
+void F2fsScannerTest::checkSit(F2fsScanner& scanner, const std::string& directory) {
+    // dump_sit holds "segno: N  vblocks: N  seg_type: N ..." per main-area segment
+    std::string output;
+    CHECK(runCommand("cat '" + directory + "/dump_sit'", output));
+    static const std::regex kSegment("segno:\\s*([0-9]+)\\s+vblocks:\\s*([0-9]+)\\s+seg_type:\\s*([0-9]+)");
+
+    CHECK(scanner.readSit());
+    size_t segments = 0;
+    for (std::sregex_iterator it(output.begin(), output.end(), kSegment), end; it != end; ++it) {
+        const size_t segment = std::stoul((*it)[1]);
+        CHECK(segment < scanner.m_segments.size());
+        if (segment >= scanner.m_segments.size()) {
+            continue;
+        }
+        const auto& entry = scanner.m_segments[segment];
+        CHECK_EQ(entry.validBlocks, std::stoull((*it)[2]));
+        CHECK_EQ(entry.type, std::stoull((*it)[3]));
+        ++segments;
+    }
+    CHECK_EQ(segments, scanner.m_segments.size());
+
+    // The valid maps must agree with the counts they came with
+    for (const auto& entry : scanner.m_segments) {
+        size_t valid = 0;
+        for (uint8_t byte : entry.validMap) {
+            valid += __builtin_popcount(byte);
+        }
+        CHECK_EQ(valid, entry.validBlocks);
+    }
+}
+
+void F2fsScannerTest::checkNat(F2fsScanner& scanner, const std::string& directory) {
+    // dump_nat holds "nid: N  ino: N  offset: N  blkaddr: N ..." per node id in use. The
+    // checkpoint journal's entries are listed as well as the NAT blocks', so a node id
+    // updated since the last NAT flush shows up twice, once with its stale address.
+    std::string output;
+    CHECK(runCommand("cat '" + directory + "/dump_nat'", output));
+    static const std::regex kNode("nid:\\s*([0-9]+)\\s+ino:\\s*([0-9]+).*?blkaddr:\\s*([0-9]+)");
+
+    CHECK(scanner.readNat());
+    std::map<size_t, std::vector<F2fsScanner::NatEntry>> listed;
+    for (std::sregex_iterator it(output.begin(), output.end(), kNode), end; it != end; ++it) {
+        const size_t nid = std::stoul((*it)[1]);
+        CHECK(nid < scanner.m_nat.size());
+        if (nid < scanner.m_nat.size()) {
+            listed[nid].push_back({(uint32_t)std::stoul((*it)[2]), (uint32_t)std::stoul((*it)[3])});
+        }
+    }
+
+    // Each node id the dump lists must match one of its entries there
+    size_t inUse = 0;
+    for (const auto& node : listed) {
+        const auto& entry = scanner.m_nat[node.first];
+        bool matched = false;
+        for (const auto& candidate : node.second) {
+            matched |= candidate.blockAddress == entry.blockAddress &&
+                       (entry.blockAddress == 0 || candidate.ino == entry.ino);
+        }
+        CHECK(matched);
+        if (!matched) {
+            std::fprintf(stderr, "nid %zu: scanner has ino %u at %u, not as dump.f2fs lists it\n", node.first,
+                         entry.ino, entry.blockAddress);
+        }
+        inUse += matched && entry.blockAddress != 0;
+    }
+    size_t used = 0;
+    for (const auto& entry : scanner.m_nat) {
+        used += entry.blockAddress != 0;
+    }
+    CHECK(inUse > 0);
+    CHECK_EQ(used, inUse);
+}
+
+// A small image laid out the way the kernel leaves one: two checkpoint segments, two SIT
+// and two NAT segments, then six main segments of 512 blocks. Only what the scanner reads
+// is filled in.
+static constexpr uint32_t kBlockSize = 4096;
+static constexpr uint32_t kSegmentBlocks = 512;
+static constexpr uint32_t kCheckpointAddress = 512;
+static constexpr uint32_t kSitAddress = 1536;
+static constexpr uint32_t kNatAddress = 2560;
+static constexpr uint32_t kMainAddress = 3584;
+static constexpr uint32_t kMainSegments = 6;
+static constexpr uint64_t kCheckpointVersion = 10;
+static constexpr uint32_t kRootIno = 3;
+
+static constexpr uint8_t kInlineData = 0x2;
+static constexpr uint8_t kInlineDentry = 0x4;
+static constexpr uint32_t kFsyncFlag = 1 << 1;
+
+static void writeLe16(uint8_t* p, uint16_t value) {
+    p[0] = (uint8_t)value;
+    p[1] = (uint8_t)(value >> 8);
+}
+
+static void writeLe32(uint8_t* p, uint32_t value) {
+    writeLe16(p, (uint16_t)value);
+    writeLe16(p + 2, (uint16_t)(value >> 16));
+}
+
+static void writeLe64(uint8_t* p, uint64_t value) {
+    writeLe32(p, (uint32_t)value);
+    writeLe32(p + 4, (uint32_t)(value >> 32));
+}
+
+struct F2fsImage {
+    std::vector<uint8_t> bytes;
+    bool extraAttributes;
+    std::vector<std::pair<uint32_t, uint32_t>> natJournal; // nid, ino of entries freed since the NAT flush
+
+    explicit F2fsImage(bool extra)
+        : bytes((size_t)(kMainAddress + kMainSegments * kSegmentBlocks) * kBlockSize), extraAttributes(extra) {}
+
+    uint8_t* block(uint32_t address) { return bytes.data() + (size_t)address * kBlockSize; }
+
+    static uint32_t mainBlock(uint32_t segment, uint32_t offset) {
+        return kMainAddress + segment * kSegmentBlocks + offset;
+    }
+
+    // i_addr slots ahead of the inline area: i_extra_isize / 4 of them with extra attributes
+    uint32_t extraSlots() const { return extraAttributes ? 9 : 0; }
+
+    // i_addr slots left for block pointers; as in the kernel, inline dentries reserve the
+    // default inline xattr room, and a flexible inline xattr size applies to every inode
+    uint32_t addressSlots(uint8_t inlineFlags) const {
+        const uint32_t xattr = extraAttributes || (inlineFlags & kInlineDentry) ? 50 : 0;
+        return 923 - extraSlots() - xattr;
+    }
+
+    uint8_t* inlineArea(uint32_t address) { return block(address) + 360 + (extraSlots() + 1) * 4; }
+
+    void writeFooter(uint32_t address, uint32_t nid, uint32_t ino, uint64_t cpVersion, uint32_t flags = 0) {
+        uint8_t* footer = block(address) + kBlockSize - 24;
+        writeLe32(footer, nid);
+        writeLe32(footer + 4, ino);
+        writeLe32(footer + 8, flags);
+        writeLe64(footer + 12, cpVersion);
+    }
+
+    // An inode block for a file or directory; the caller fills in the content
+    void writeInode(uint32_t address, uint32_t ino, uint16_t mode, uint8_t inlineFlags, uint64_t size,
+                    uint32_t parent, const std::string& name, uint64_t cpVersion, uint32_t footerFlags = 0) {
+        uint8_t* inode = block(address);
+        writeLe16(inode, mode);
+        inode[3] = inlineFlags | (extraAttributes ? 0x20 : 0);
+        writeLe32(inode + 12, 1); // i_links
+        writeLe64(inode + 16, size);
+        writeLe64(inode + 32, 1700000000); // i_atime
+        writeLe64(inode + 40, 1700000000); // i_ctime
+        writeLe64(inode + 48, 1700000000); // i_mtime
+        writeLe32(inode + 84, parent);
+        writeLe32(inode + 88, (uint32_t)name.size());
+        memcpy(inode + 92, name.data(), name.size());
+        if (extraAttributes) {
+            writeLe16(inode + 360, 36); // i_extra_isize
+            writeLe16(inode + 362, 50); // i_inline_xattr_size
+        }
+        writeFooter(address, ino, ino, cpVersion, footerFlags);
+    }
+
+    void writeInlineData(uint32_t address, const std::vector<uint8_t>& content) {
+        memcpy(inlineArea(address), content.data(), content.size());
+    }
+
+    // Block pointers, from the first i_addr slot past the extra attributes or the first
+    // slot of a direct node
+    void writeAddresses(uint8_t* slots, uint32_t first, uint32_t count) {
+        for (uint32_t i = 0; i < count; ++i) {
+            writeLe32(slots + i * 4, first + i);
+        }
+    }
+
+    void writeData(uint32_t address, const uint8_t* data, size_t length) {
+        memcpy(block(address), data, length);
+    }
+
+    // An entry of an inline dentry area, as the kernel sizes it for the directory's inode
+    void writeDentry(uint32_t address, size_t slot, uint32_t ino, const std::string& name, bool live) {
+        const size_t inlineBytes = (addressSlots(kInlineDentry) - 1) * 4;
+        const size_t slots = inlineBytes * 8 / ((11 + 8) * 8 + 1);
+        const size_t bitmapBytes = (slots + 7) / 8;
+        const size_t reserved = inlineBytes - ((11 + 8) * slots + bitmapBytes);
+        uint8_t* area = inlineArea(address);
+        uint8_t* dentry = area + bitmapBytes + reserved + slot * 11;
+        writeLe32(dentry + 4, ino);
+        writeLe16(dentry + 8, (uint16_t)name.size());
+        dentry[10] = 1; // regular file
+        memcpy(area + bitmapBytes + reserved + slots * 11 + slot * 8, name.data(), name.size());
+        // Unlinking only clears the entry's bitmap bits
+        if (live) {
+            for (size_t i = slot; i < slot + (name.size() + 7) / 8; ++i) {
+                area[i / 8] |= (uint8_t)(1 << (i % 8));
+            }
+        }
+    }
+
+    void setNat(uint32_t nid, uint32_t ino, uint32_t address) {
+        uint8_t* entry = block(kNatAddress) + nid * 9;
+        writeLe32(entry + 1, ino);
+        writeLe32(entry + 5, address);
+    }
+
+    void setSegment(uint32_t segment, uint8_t type, const std::vector<uint32_t>& validBlocks) {
+        uint8_t* entry = block(kSitAddress) + segment * 74;
+        writeLe16(entry, (uint16_t)(validBlocks.size() | (type << 10)));
+        for (uint32_t valid : validBlocks) {
+            entry[2 + valid / 8] |= (uint8_t)(0x80 >> (valid % 8));
+        }
+    }
+
+    // Superblock, then one checkpoint pack of head, compacted summary and closing block
+    void finish(const uint32_t currentNodeSegments[3], const uint16_t currentNodeOffsets[3]) {
+        uint8_t* sb = bytes.data() + 1024;
+        writeLe32(sb, 0xF2F52010);
+        writeLe32(sb + 0x10, 12); // log_blocksize
+        writeLe32(sb + 0x14, 9);  // log_blocks_per_seg
+        writeLe32(sb + 0x38, 2);  // segment_count_sit
+        writeLe32(sb + 0x3C, 2);  // segment_count_nat
+        writeLe32(sb + 0x44, kMainSegments);
+        writeLe32(sb + 0x4C, kCheckpointAddress);
+        writeLe32(sb + 0x50, kSitAddress);
+        writeLe32(sb + 0x54, kNatAddress);
+        writeLe32(sb + 0x5C, kMainAddress);
+        writeLe32(sb + 0x60, kRootIno);
+        writeLe32(sb + 0x64, 1); // node_ino
+        writeLe32(sb + 0x68, 2); // meta_ino
+        writeLe32(sb + 0x884, extraAttributes ? 0x8 | 0x40 : 0); // extra_attr, flexible_inline_xattr
+
+        uint8_t* checkpoint = block(kCheckpointAddress);
+        writeLe64(checkpoint, kCheckpointVersion);
+        for (int i = 0; i < 3; ++i) {
+            writeLe32(checkpoint + 36 + i * 4, currentNodeSegments[i]);
+            writeLe16(checkpoint + 68 + i * 2, currentNodeOffsets[i]);
+        }
+        writeLe32(checkpoint + 132, 0x1 | 0x4); // umount, compacted summaries
+        writeLe32(checkpoint + 136, 3);         // cp_pack_total_block_count
+        writeLe32(checkpoint + 140, 1);         // cp_pack_start_sum
+        writeLe32(checkpoint + 156, 64);        // SIT and NAT version bitmaps, all clear
+        writeLe32(checkpoint + 160, 64);
+        writeLe32(checkpoint + 164, kBlockSize - 4);
+        writeLe32(checkpoint + kBlockSize - 4,
+                  ~(uint32_t)crc32(~0xF2F52010u, checkpoint, kBlockSize - 4));
+        memcpy(block(kCheckpointAddress + 2), checkpoint, kBlockSize);
+
+        // The NAT journal opens the compacted summary block
+        uint8_t* journal = block(kCheckpointAddress + 1);
+        writeLe16(journal, (uint16_t)natJournal.size());
+        for (size_t i = 0; i < natJournal.size(); ++i) {
+            writeLe32(journal + 2 + i * 13, natJournal[i].first);
+            writeLe32(journal + 2 + i * 13 + 5, natJournal[i].second);
+        }
+    }
+};
+
+// Deletes files the way the kernel does, leaving their node blocks invalid but in place,
+// then checks that the scanner finds the newest complete copy of each under its old path
+void F2fsScannerTest::checkDeletedFiles(const TempDirectory& directory, bool extraAttributes) {
+    F2fsImage image(extraAttributes);
+    const uint16_t kDirectory = 0x41ED;
+    const uint16_t kFile = 0x81A4;
+    const uint32_t warm = 3; // warm node segment, written up to block 17
+    const uint32_t hot = 4;  // hot node segment, written up to block 2 at the checkpoint
+
+    // Live: the root, /docs with inline dentries, and /kept.txt
+    image.writeInode(F2fsImage::mainBlock(warm, 0), kRootIno, kDirectory, kInlineDentry, 4096, kRootIno, "", 9);
+    image.writeInode(F2fsImage::mainBlock(warm, 1), 4, kDirectory, kInlineDentry, 4096, kRootIno, "docs", 9);
+    image.writeInode(F2fsImage::mainBlock(warm, 3), 11, kFile, kInlineData, 50, kRootIno, "kept.txt", 9);
+    image.writeInlineData(F2fsImage::mainBlock(warm, 3), patternBytes(50, 11));
+    // An older copy of the live file is not a deleted one
+    image.writeInode(F2fsImage::mainBlock(warm, 4), 11, kFile, kInlineData, 40, kRootIno, "kept.txt", 8);
+    image.writeInlineData(F2fsImage::mainBlock(warm, 4), patternBytes(40, 12));
+
+    // /docs/small.txt, an inline file whose inodes carry no name: the dentry in an older
+    // copy of /docs names it. Of its copies, the newest with content wins; those written
+    // after the checkpoint, or fsync'd under it for roll-forward, are not deleted ones.
+    const std::vector<uint8_t> small = patternBytes(400, 5);
+    image.writeInode(F2fsImage::mainBlock(warm, 2), 4, kDirectory, kInlineDentry, 4096, kRootIno, "docs", 8);
+    image.writeDentry(F2fsImage::mainBlock(warm, 2), 0, 5, "small.txt", true);
+    image.writeInode(F2fsImage::mainBlock(warm, 5), 5, kFile, kInlineData, small.size(), 4, "", 9);
+    image.writeInlineData(F2fsImage::mainBlock(warm, 5), small);
+    image.writeInode(F2fsImage::mainBlock(warm, 6), 5, kFile, kInlineData, 300, 4, "", 7);
+    image.writeInlineData(F2fsImage::mainBlock(warm, 6), patternBytes(300, 6));
+    image.writeInode(F2fsImage::mainBlock(warm, 7), 5, kFile, kInlineData, 0, 4, "", 10);
+    image.writeInode(F2fsImage::mainBlock(warm, 8), 5, kFile, kInlineData, 450, 4, "", 10, kFsyncFlag);
+    image.writeInlineData(F2fsImage::mainBlock(warm, 8), patternBytes(450, 7));
+    image.writeInode(F2fsImage::mainBlock(warm, 9), 5, kFile, kInlineData, 420, 4, "", 11);
+    image.writeInlineData(F2fsImage::mainBlock(warm, 9), patternBytes(420, 8));
+
+    // /big.bin: more blocks than the inode maps, so the rest come from direct node 20. A
+    // stale copy of that node points elsewhere.
+    const uint32_t bigBlocks = 1023;
+    const std::vector<uint8_t> big = patternBytes(bigBlocks * kBlockSize - 1000, 9);
+    const uint32_t inodeBlocks = image.addressSlots(0);
+    const uint32_t tail = F2fsImage::mainBlock(0, 1100);
+    image.writeInode(F2fsImage::mainBlock(warm, 10), 6, kFile, 0, big.size(), kRootIno, "big.bin", 9);
+    uint8_t* inode = image.block(F2fsImage::mainBlock(warm, 10));
+    image.writeAddresses(inode + 360 + image.extraSlots() * 4, F2fsImage::mainBlock(0, 0), inodeBlocks);
+    writeLe32(inode + 4052, 20); // i_nid[0]
+    image.writeData(F2fsImage::mainBlock(0, 0), big.data(), (size_t)inodeBlocks * kBlockSize);
+    image.writeData(tail, big.data() + (size_t)inodeBlocks * kBlockSize, big.size() - (size_t)inodeBlocks * kBlockSize);
+    image.writeAddresses(image.block(F2fsImage::mainBlock(warm, 11)), tail, bigBlocks - inodeBlocks);
+    image.writeFooter(F2fsImage::mainBlock(warm, 11), 20, 6, 9);
+    image.writeAddresses(image.block(F2fsImage::mainBlock(warm, 16)), F2fsImage::mainBlock(0, 1400),
+                         bigBlocks - inodeBlocks);
+    image.writeFooter(F2fsImage::mainBlock(warm, 16), 20, 6, 8);
+
+    // /album, a deleted directory holding an inline file and a nameless two-block file
+    const std::vector<uint8_t> note = patternBytes(500, 10);
+    const std::vector<uint8_t> photo = patternBytes(6000, 13);
+    image.writeInode(F2fsImage::mainBlock(warm, 12), 7, kDirectory, kInlineDentry, 4096, kRootIno, "album", 9);
+    image.writeDentry(F2fsImage::mainBlock(warm, 12), 0, 8, "note.txt", false);
+    image.writeDentry(F2fsImage::mainBlock(warm, 12), 1, 9, "photo.bin", false);
+    image.writeInode(F2fsImage::mainBlock(warm, 13), 8, kFile, kInlineData, note.size(), 7, "note.txt", 9);
+    image.writeInlineData(F2fsImage::mainBlock(warm, 13), note);
+    image.writeInode(F2fsImage::mainBlock(warm, 14), 9, kFile, 0, photo.size(), 7, "", 9);
+    inode = image.block(F2fsImage::mainBlock(warm, 14));
+    writeLe32(inode + 360 + image.extraSlots() * 4, F2fsImage::mainBlock(2, 10));
+    writeLe32(inode + 360 + image.extraSlots() * 4 + 4, F2fsImage::mainBlock(2, 12));
+    image.writeData(F2fsImage::mainBlock(2, 10), photo.data(), kBlockSize);
+    image.writeData(F2fsImage::mainBlock(2, 12), photo.data() + kBlockSize, photo.size() - kBlockSize);
+
+    // Noise where a node was, and a deleted file's inode the hot log wrote after the checkpoint
+    const std::vector<uint8_t> noise = patternBytes(kBlockSize, 14);
+    image.writeData(F2fsImage::mainBlock(warm, 15), noise.data(), noise.size());
+    image.writeInode(F2fsImage::mainBlock(hot, 3), 10, kFile, kInlineData, 100, kRootIno, "ghost.bin", 10);
+    image.writeInlineData(F2fsImage::mainBlock(hot, 3), patternBytes(100, 15));
+
+    image.setNat(1, 1, 1);
+    image.setNat(2, 2, 1);
+    image.setNat(kRootIno, kRootIno, F2fsImage::mainBlock(warm, 0));
+    image.setNat(4, 4, F2fsImage::mainBlock(warm, 1));
+    image.setNat(11, 11, F2fsImage::mainBlock(warm, 3));
+    // /big.bin was freed after the last NAT flush, so only the journal knows
+    image.setNat(6, 6, F2fsImage::mainBlock(warm, 10));
+    image.natJournal.push_back({6, 6});
+    for (uint32_t segment = 0; segment < 3; ++segment) {
+        image.setSegment(segment, 1, {});
+    }
+    image.setSegment(warm, 4, {0, 1, 3});
+    image.setSegment(hot, 3, {});
+    image.setSegment(5, 5, {});
+    const uint32_t currentSegments[3] = {hot, warm, 5};
+    const uint16_t currentOffsets[3] = {2, 17, 0};
+    image.finish(currentSegments, currentOffsets);
+
+    const std::string path = directory.file("deleted.img");
+    CHECK(writeFile(path, image.bytes));
+
+    F2fsScanner scanner;
+    CHECK(scanner.initialize(true));
+    const auto results = scanner.scanDeletedFiles(path, {}, nullptr);
+    const std::map<std::string, const std::vector<uint8_t>*> expected = {
+        {"/data/docs/small.txt", &small},
+        {"/data/big.bin", &big},
+        {"/data/album/note.txt", &note},
+        {"/data/album/photo.bin", &photo},
+    };
+    CHECK_EQ(results.size(), expected.size());
+
+    BlockDevice device;
+    CHECK(device.open(path));
+    for (const auto& result : results) {
+        auto found = expected.find(result.path);
+        CHECK(found != expected.end());
+        if (found == expected.end()) {
+            std::fprintf(stderr, "unexpected deleted file %s\n", result.path.c_str());
+            continue;
+        }
+        CHECK(result.isRecoverable);
+        std::vector<uint8_t> content;
+        for (const auto& extent : result.extents) {
+            std::vector<uint8_t> bytes((size_t)extent.length);
+            CHECK_EQ(device.read((uint64_t)extent.offset, bytes.data(), bytes.size()), (long long)bytes.size());
+            content.insert(content.end(), bytes.begin(), bytes.end());
+        }
+        CHECK(content == *found->second);
+    }
+}
+
+int main() {
+    TempDirectory directory;
+    CHECK(directory.valid());
+    F2fsScannerTest::checkDeletedFiles(directory, false);
+    F2fsScannerTest::checkDeletedFiles(directory, true);
+
+    if (!haveTool("mkfs.f2fs") || !haveTool("sload.f2fs") || !haveTool("dump.f2fs")) {
+        std::fprintf(stderr, "f2fs-tools not installed, skipping the dump.f2fs checks\n");
+        return g_testFailures > 0 ? testResult() : kTestSkipped;
+    }
+
+    const std::string source = directory.file("source");
+    CHECK(runCommand("mkdir -p '" + source + "/media/deep'"));
+    CHECK(writeFile(source + "/photo.bin", patternBytes(70000, 1)));
+    CHECK(writeFile(source + "/media/page.txt", patternBytes(3000, 2)));
+    CHECK(writeFile(source + "/media/deep/archive.bin", patternBytes(300000, 3)));
+    CHECK(writeFile(source + "/tiny.txt", patternBytes(100, 4)));
+
+    // The default layout, and the extra attribute layout Android formats /data with
+    const char* const features[] = {"", "-O extra_attr,inode_checksum,flexible_inline_xattr"};
+    for (const char* feature : features) {
+        const std::string image = directory.file("f2fs.img");
+        CHECK(runCommand("rm -f '" + image + "' && truncate -s 128M '" + image + "'"));
+        CHECK(runCommand(std::string("mkfs.f2fs -q -f ") + feature + " '" + image + "' >/dev/null 2>&1"));
+        CHECK(runCommand("sload.f2fs -f '" + source + "' '" + image + "' >/dev/null 2>&1"));
+        // dump.f2fs writes dump_sit and dump_nat into its working directory
+        CHECK(runCommand("cd '" + directory.path() + "' && dump.f2fs -s 0~-1 '" + image + "' >/dev/null 2>&1"));
+        CHECK(runCommand("cd '" + directory.path() + "' && dump.f2fs -n 0~-1 '" + image + "' >/dev/null 2>&1"));
+
+        F2fsScanner scanner;
+        CHECK(scanner.initialize(true));
+        F2fsScannerTest::checkCheckpoint(scanner, image);
+        F2fsScannerTest::checkSit(scanner, directory.path());
+        F2fsScannerTest::checkNat(scanner, directory.path());
+    }
+    return testResult();
+}
@@ -0,0 +1,98 @@
+// Carves synthetic device images and checks the files found against what was planted
+#include "test_support.h"
+#include "../recovery/file_carver.h"
+
+#include <cstring>
+
+static void appendBe32(std::vector<uint8_t>& out, uint32_t value) {
+    for (int shift = 24; shift >= 0; shift -= 8) {
+        out.push_back((uint8_t)(value >> shift));
+    }
+}
+
+static void appendBox(std::vector<uint8_t>& out, const char* type, const std::vector<uint8_t>& payload) {
+    appendBe32(out, (uint32_t)(8 + payload.size()));
+    out.insert(out.end(), type, type + 4);
+    out.insert(out.end(), payload.begin(), payload.end());
+}
+
+// ftyp, moov and an mdat padded so the file fills whole 4 KiB blocks, as on a filesystem
+static std::vector<uint8_t> makeMp4(size_t blocks, uint32_t seed) {
+    std::vector<uint8_t> file;
+    appendBox(file, "ftyp", {'i', 's', 'o', 'm', 0, 0, 2, 0, 'i', 's', 'o', 'm', 'm', 'p', '4', '1'});
+    appendBox(file, "moov", std::vector<uint8_t>(600, 0));
+    appendBox(file, "mdat", patternBytes(blocks * 4096 - file.size() - 8, seed));
+    return file;
+}
+
+static const RecoveredFileInfo* findCarved(const std::vector<RecoveredFileInfo>& results, uint64_t offset) {
+    const std::string suffix = "_carved_" + std::to_string(offset);
+    for (const auto& result : results) {
+        if (result.path.size() >= suffix.size() &&
+            result.path.compare(result.path.size() - suffix.size(), suffix.size(), suffix) == 0) {
+            return &result;
+        }
+    }
+    return nullptr;
+}
+
+// Two MP4s back to back: the first must end where the second's ftyp begins
+static void checkAdjacentMp4(const TempDirectory& directory) {
+    const std::vector<uint8_t> first = makeMp4(10, 1);
+    const std::vector<uint8_t> second = makeMp4(7, 2);
+    const uint64_t firstOffset = 1024 * 1024;
+    const uint64_t secondOffset = firstOffset + first.size();
+
+    std::vector<uint8_t> image(4 * 1024 * 1024, 0);
+    std::copy(first.begin(), first.end(), image.begin() + firstOffset);
+    std::copy(second.begin(), second.end(), image.begin() + secondOffset);
+    const std::string path = directory.file("mp4.img");
+    CHECK(writeFile(path, image));
+
+    FileCarver carver;
+    const auto results = carver.carveFiles(path, {2}, nullptr);
+    const RecoveredFileInfo* firstFound = findCarved(results, firstOffset);
+    const RecoveredFileInfo* secondFound = findCarved(results, secondOffset);
+    CHECK(firstFound != nullptr);
+    CHECK(secondFound != nullptr);
+    if (firstFound) {
+        CHECK_EQ(firstFound->size, (long long)first.size());
+    }
+    if (secondFound) {
+        CHECK_EQ(secondFound->size, (long long)second.size());
+    }
+}
+
+// A ZIP whose body is high-entropy data and whose end record lies deep inside a run of
+// such blocks, where the automaton does not run; a stray header off a sector boundary
+// in the same noise is not a file start
+static void checkFooterInNoise(const TempDirectory& directory) {
+    std::vector<uint8_t> image = patternBytes(8 * 1024 * 1024, 3);
+    const uint64_t start = 2 * 1024 * 1024 + 3 * 4096;
+    const uint64_t footer = start + 300000 + 123;
+    const uint64_t stray = 5 * 1024 * 1024 + 100;
+    const uint8_t header[] = {'P', 'K', 3, 4};
+    const uint8_t end[] = {'P', 'K', 5, 6};
+    std::copy(header, header + 4, image.begin() + start);
+    std::copy(end, end + 4, image.begin() + footer);
+    std::copy(header, header + 4, image.begin() + stray);
+    const std::string path = directory.file("zip.img");
+    CHECK(writeFile(path, image));
+
+    FileCarver carver;
+    const auto results = carver.carveFiles(path, {5}, nullptr);
+    const RecoveredFileInfo* found = findCarved(results, start);
+    CHECK(found != nullptr);
+    if (found) {
+        CHECK_EQ(found->size, (long long)(footer + 4 + 18 - start));
+    }
+    CHECK(findCarved(results, stray) == nullptr);
+}
+
+int main() {
+    TempDirectory directory;
+    CHECK(directory.valid());
+    checkAdjacentMp4(directory);
+    checkFooterInNoise(directory);
+    return testResult();
+}
@@ -0,0 +1,220 @@
+// Splits JPEGs and PNGs around foreign data the way a fragmented filesystem leaves them,
+// and checks that the gap finders bridge exactly the planted gap and nothing else
+#include "test_support.h"
+#include "../recovery/format_walker.h"
+
+#include <fstream>
+#include <iterator>
+#include <zlib.h>
+
+// A device image held in memory
+class MemorySource : public ByteSource {
+public:
+    std::vector<uint8_t> bytes;
+
+    const uint8_t* fetch(uint64_t offset, size_t minLength, size_t& available) override {
+        if (offset >= bytes.size() || minLength > bytes.size() - offset) {
+            return nullptr;
+        }
+        available = (size_t)(bytes.size() - offset);
+        return bytes.data() + offset;
+    }
+    using ByteSource::fetch;
+
+    uint64_t size() const override { return bytes.size(); }
+};
+
+static constexpr uint64_t kFileOffset = 8192;
+static constexpr uint64_t kMaxSize = 8 << 20;
+
+static std::vector<uint8_t> readFile(const std::string& path) {
+    std::ifstream file(path, std::ios::binary);
+    return {std::istreambuf_iterator<char>(file), {}};
+}
+
+// Lays out [zeros][file up to split][gap][file from split, or foreign data][zeros] and
+// returns the offset the file starts at
+static uint64_t buildImage(MemorySource& source, const std::vector<uint8_t>& file, size_t split,
+                           const std::vector<uint8_t>& gap, const std::vector<uint8_t>& rest) {
+    source.bytes.assign(kFileOffset, 0);
+    source.bytes.insert(source.bytes.end(), file.begin(), file.begin() + split);
+    source.bytes.insert(source.bytes.end(), gap.begin(), gap.end());
+    source.bytes.insert(source.bytes.end(), rest.begin(), rest.end());
+    source.bytes.resize(source.bytes.size() + 65536, 0);
+    return kFileOffset;
+}
+
+static void checkBridged(bool found, const GapResult& gap, uint64_t breakOffset, uint64_t gapLength,
+                         uint64_t length) {
+    CHECK(found);
+    CHECK_EQ(gap.breakOffset, breakOffset);
+    CHECK_EQ(gap.resumeOffset, breakOffset + gapLength);
+    CHECK_EQ(gap.length, length);
+}
+
+// Random blocks, then the second half of another JPEG through its EOI, padded with random
+// bytes to whole blocks: the foreign tail carries the same Huffman tables and a real EOI
+static std::vector<uint8_t> jpegGap(const std::vector<uint8_t>& foreign, size_t minimum, uint32_t seed) {
+    std::vector<uint8_t> gap = patternBytes(8192, seed);
+    gap.reserve(gap.size() + foreign.size() + minimum + FormatWalker::kBlockSize);
+    gap.insert(gap.end(), foreign.begin() + (foreign.size() / 2 & ~(size_t)(FormatWalker::kBlockSize - 1)),
+               foreign.end());
+    const std::vector<uint8_t> padding = patternBytes(minimum + FormatWalker::kBlockSize, seed + 1);
+    size_t used = 0;
+    while (gap.size() % FormatWalker::kBlockSize != 0 || gap.size() < minimum) {
+        gap.push_back(padding[used++]);
+    }
+    return gap;
+}
+
+static void checkJpeg(const std::string& name, const std::vector<uint8_t>& file, const std::vector<uint8_t>& foreign,
+                      size_t split, size_t minimumGap) {
+    std::fprintf(stderr, "%s split at %zu\n", name.c_str(), split);
+    const std::vector<uint8_t> gap = jpegGap(foreign, minimumGap, (uint32_t)split);
+    MemorySource source;
+    const uint64_t offset = buildImage(source, file, split, gap, {file.begin() + split, file.end()});
+
+    const WalkResult walked = FormatWalker::walkJpeg(source, offset, kMaxSize);
+    CHECK(!walked.complete);
+    GapResult found{};
+    checkBridged(FormatWalker::findJpegGap(source, offset, kMaxSize, walked, found), found, offset + split,
+                 gap.size(), file.size());
+}
+
+// With the rest of the file gone, the foreign tail must not be taken for it
+static void checkJpegWithoutRest(const std::string& name, const std::vector<uint8_t>& file,
+                                 const std::vector<uint8_t>& foreign, size_t split) {
+    std::fprintf(stderr, "%s split at %zu, rest missing\n", name.c_str(), split);
+    std::vector<uint8_t> rest;
+    for (size_t i = 0; i < 300000; ++i) {
+        rest.push_back(foreign[1000 + i * 7 % (foreign.size() - 2000)]);
+    }
+    MemorySource source;
+    const uint64_t offset = buildImage(source, file, split, jpegGap(foreign, 20480, (uint32_t)split), rest);
+
+    const WalkResult walked = FormatWalker::walkJpeg(source, offset, kMaxSize);
+    CHECK(!walked.complete);
+    GapResult found{};
+    CHECK(!FormatWalker::findJpegGap(source, offset, kMaxSize, walked, found));
+}
+
+// Photos with enough detail to spread the scan data over many blocks, saved as baseline,
+// progressive and restart-marker JPEGs
+static const char kMakeJpegs[] = R"(
+import random, sys
+from PIL import Image
+def image(seed):
+    random.seed(seed)
+    img = Image.new('RGB', (640, 480))
+    img.putdata([((x * seed + y) % 256, (y * 3 + seed * x // 7) % 256, (random.randint(0, 60) + x) % 256)
+                 for y in range(480) for x in range(640)])
+    return img
+out = sys.argv[1]
+image(3).save(out + '/baseline.jpg', quality=90)
+image(5).save(out + '/foreign.jpg', quality=85)
+image(3).save(out + '/progressive.jpg', quality=90, progressive=True)
+image(3).save(out + '/restart.jpg', quality=90, restart_marker_blocks=4)
+)";
+
+static void checkJpegs(const TempDirectory& directory) {
+    const std::string script = directory.file("make_jpegs.py");
+    CHECK(writeFile(script, std::vector<uint8_t>(kMakeJpegs, kMakeJpegs + sizeof(kMakeJpegs) - 1)));
+    CHECK(runCommand("python3 '" + script + "' '" + directory.path() + "'"));
+
+    const std::vector<uint8_t> foreign = readFile(directory.file("foreign.jpg"));
+    const std::vector<uint8_t> restart = readFile(directory.file("restart.jpg"));
+    CHECK(foreign.size() > 65536 && restart.size() > 65536);
+    if (foreign.size() <= 65536 || restart.size() <= 65536) {
+        return;
+    }
+
+    // Breaks land on block boundaries of the image, so splits are block multiples less
+    // the file's own offset
+    const size_t early = 40960 - kFileOffset;
+    const size_t late = 61440 - kFileOffset;
+    for (const char* name : {"baseline.jpg", "progressive.jpg", "restart.jpg"}) {
+        const std::vector<uint8_t> file = readFile(directory.file(name));
+        CHECK(file.size() > late);
+        if (file.size() <= late) {
+            continue;
+        }
+        checkJpeg(name, file, foreign, early, 20480);
+        checkJpeg(name, file, restart, early, 20480);
+        checkJpegWithoutRest(name, file, foreign, early);
+        checkJpegWithoutRest(name, file, restart, early);
+    }
+    // Long gaps; a break inside a progressive refinement scan has no restart markers to
+    // resynchronise on, so only the sequential files are expected to bridge this one
+    checkJpeg("baseline.jpg", readFile(directory.file("baseline.jpg")), foreign, late, 4096 * 37);
+    checkJpeg("restart.jpg", restart, foreign, late, 4096 * 37);
+}
+
+static void appendChunk(std::vector<uint8_t>& png, const char* type, const std::vector<uint8_t>& data) {
+    for (int shift = 24; shift >= 0; shift -= 8) {
+        png.push_back((uint8_t)(data.size() >> shift));
+    }
+    const size_t typeStart = png.size();
+    png.insert(png.end(), type, type + 4);
+    png.insert(png.end(), data.begin(), data.end());
+    const uLong crc = crc32(0L, png.data() + typeStart, (uInt)(png.size() - typeStart));
+    for (int shift = 24; shift >= 0; shift -= 8) {
+        png.push_back((uint8_t)(crc >> shift));
+    }
+}
+
+// A 256x256 RGB PNG of noise, so the single IDAT spans dozens of blocks
+static std::vector<uint8_t> makePng() {
+    const size_t width = 256;
+    const size_t height = 256;
+    std::vector<uint8_t> raw;
+    const std::vector<uint8_t> noise = patternBytes(width * height * 3, 7);
+    for (size_t y = 0; y < height; ++y) {
+        raw.push_back(0); // filter: none
+        raw.insert(raw.end(), noise.begin() + y * width * 3, noise.begin() + (y + 1) * width * 3);
+    }
+    uLongf compressedLength = compressBound(raw.size());
+    std::vector<uint8_t> compressed(compressedLength);
+    CHECK(compress(compressed.data(), &compressedLength, raw.data(), raw.size()) == Z_OK);
+    compressed.resize(compressedLength);
+
+    std::vector<uint8_t> png = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+    appendChunk(png, "IHDR", {0, 0, 1, 0, 0, 0, 1, 0, 8, 2, 0, 0, 0});
+    appendChunk(png, "IDAT", compressed);
+    appendChunk(png, "IEND", {});
+    return png;
+}
+
+static void checkPng() {
+    const std::vector<uint8_t> png = makePng();
+    const size_t split = 40960 - kFileOffset;
+    CHECK(png.size() > split + 65536);
+
+    // Random blocks inside IDAT, and the rest of the file after them
+    const std::vector<uint8_t> gap = patternBytes(12288, 8);
+    MemorySource source;
+    uint64_t offset = buildImage(source, png, split, gap, {png.begin() + split, png.end()});
+    WalkResult walked = FormatWalker::walkPng(source, offset, kMaxSize);
+    CHECK(!walked.complete);
+    GapResult found{};
+    checkBridged(FormatWalker::findPngGap(source, offset, kMaxSize, walked, found), found, offset + split,
+                 gap.size(), png.size());
+
+    // The same gap with the rest of the file gone
+    offset = buildImage(source, png, split, gap, patternBytes(200000, 9));
+    walked = FormatWalker::walkPng(source, offset, kMaxSize);
+    CHECK(!walked.complete);
+    CHECK(!FormatWalker::findPngGap(source, offset, kMaxSize, walked, found));
+}
+
+int main() {
+    checkPng();
+
+    if (!runCommand("python3 -c 'import PIL' >/dev/null 2>&1")) {
+        std::fprintf(stderr, "python3 with Pillow not installed, skipping the JPEG checks\n");
+        return g_testFailures > 0 ? testResult() : kTestSkipped;
+    }
+    TempDirectory directory;
+    CHECK(directory.valid());
+    checkJpegs(directory);
+    return testResult();
+}
@@ -0,0 +1,56 @@
+// Checks that ByteSet::findFirst agrees with a plain table scan, and that the built-in
+// signature database's first bytes are searched with the vector kernel
+#include "test_support.h"
+#include "../utils/simd_scan.h"
+#include "../recovery/signature_database.h"
+
+static size_t findFirstReference(const ByteSet& set, const uint8_t* data, size_t length) {
+    for (size_t i = 0; i < length; ++i) {
+        if (set.contains(data[i])) {
+            return i;
+        }
+    }
+    return length;
+}
+
+// Many starts and lengths over a buffer that spans several vectors; most members are
+// flipped to other bytes so that hits are sparse and the kernels have to skip ahead
+static void checkAgainstReference(const ByteSet& set, uint32_t seed) {
+    std::vector<uint8_t> data = patternBytes(4096, seed);
+    for (auto& byte : data) {
+        if (set.contains(byte) && (byte & 7) != 0) {
+            byte ^= 0x80;
+        }
+    }
+    for (size_t start = 0; start < 80; ++start) {
+        for (size_t length = 0; start + length <= data.size(); length += 1 + length / 3) {
+            CHECK_EQ(set.findFirst(data.data() + start, length),
+                     findFirstReference(set, data.data() + start, length));
+        }
+    }
+}
+
+int main() {
+#if defined(__aarch64__) || defined(__x86_64__)
+    CHECK(ByteSet::vectorized());
+#endif
+
+    // The built-in database has well over eight distinct first bytes; they must still
+    // take the vector kernel, and whatever the kernel proposes is checked against the set
+    const ByteSet& firstBytes = SignatureDatabase::builtin()->matcher().firstBytes();
+    std::fprintf(stderr, "built-in database: %zu first bytes, %s nibble tables\n", firstBytes.count(),
+                 firstBytes.exact() ? "exact" : "inexact");
+    CHECK(firstBytes.count() > 8);
+    checkAgainstReference(firstBytes, 1);
+
+    // Sets from empty to large, with members drawn from the same pseudo-random sequence
+    for (size_t members = 0; members <= 64; ++members) {
+        ByteSet set;
+        const std::vector<uint8_t> values = patternBytes(members, (uint32_t)members + 100);
+        for (uint8_t value : values) {
+            set.add(value);
+        }
+        checkAgainstReference(set, (uint32_t)members + 200);
+    }
+    return testResult();
+}
@@ -0,0 +1,114 @@
+#ifndef TEST_SUPPORT_H
+#define TEST_SUPPORT_H
+
+// Minimal helpers for the host tests: checks that count failures instead of aborting, and
+// shell access to the filesystem tools whose output the scanners are compared against
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+// ctest reports a test that exits with this code as skipped (SKIP_RETURN_CODE), or as
+// failed when configured with DATARESCUE_REQUIRE_TEST_TOOLS
+static constexpr int kTestSkipped = 77;
+
+static int g_testFailures = 0;
+
+#define CHECK(condition)                                                           \
+    do {                                                                           \
+        if (!(condition)) {                                                        \
+            std::fprintf(stderr, "%s:%d: CHECK failed: %s\n", __FILE__, __LINE__,  \
+                         #condition);                                              \
+            ++g_testFailures;                                                      \
+        }                                                                          \
+    } while (0)
+
+#define CHECK_EQ(actual, expected)                                                           \
+    do {                                                                                     \
+        const auto actualValue = (actual);                                                   \
+        const auto expectedValue = (expected);                                               \
+        if (!(actualValue == expectedValue)) {                                               \
+            std::fprintf(stderr, "%s:%d: CHECK_EQ failed: %s is %llu, expected %llu\n",      \
+                         __FILE__, __LINE__, #actual, (unsigned long long)actualValue,        \
+                         (unsigned long long)expectedValue);                                  \
+            ++g_testFailures;                                                                \
+        }                                                                                    \
+    } while (0)
+
+inline int testResult() {
+    if (g_testFailures > 0) {
+        std::fprintf(stderr, "%d check(s) failed\n", g_testFailures);
+        return 1;
+    }
+    return 0;
+}
+
+// Runs a shell command and returns its standard output; false if it could not run or failed
+inline bool runCommand(const std::string& command, std::string& output) {
+    output.clear();
+    FILE* pipe = popen(command.c_str(), "r");
+    if (!pipe) {
+        return false;
+    }
+    char buffer[4096];
+    size_t length;
+    while ((length = std::fread(buffer, 1, sizeof(buffer), pipe)) > 0) {
+        output.append(buffer, length);
+    }
+    return pclose(pipe) == 0;
+}
+
+inline bool runCommand(const std::string& command) {
+    std::string output;
+    return runCommand(command, output);
+}
+
+inline bool haveTool(const char* tool) {
+    return runCommand(std::string("command -v ") + tool + " >/dev/null 2>&1");
+}
+
+// A scratch directory removed again when the test ends
+class TempDirectory {
+public:
+    TempDirectory() {
+        char pattern[] = "/tmp/datarescue_test.XXXXXX";
+        if (mkdtemp(pattern)) {
+            m_path = pattern;
+        }
+    }
+    ~TempDirectory() {
+        if (!m_path.empty()) {
+            runCommand("rm -rf '" + m_path + "'");
+        }
+    }
+
+    bool valid() const { return !m_path.empty(); }
+    const std::string& path() const { return m_path; }
+    std::string file(const std::string& name) const { return m_path + "/" + name; }
+
+private:
+    std::string m_path;
+};
+
+// Writes length bytes from a fixed pseudo-random sequence, so content checks are repeatable
+inline std::vector<uint8_t> patternBytes(size_t length, uint32_t seed) {
+    std::vector<uint8_t> bytes(length);
+    uint32_t state = seed * 2654435761u + 1;
+    for (auto& byte : bytes) {
+        state = state * 1664525u + 1013904223u;
+        byte = (uint8_t)(state >> 24);
+    }
+    return bytes;
+}
+
+inline bool writeFile(const std::string& path, const std::vector<uint8_t>& bytes) {
+    FILE* file = std::fopen(path.c_str(), "wb");
+    if (!file) {
+        return false;
+    }
+    const bool written = std::fwrite(bytes.data(), 1, bytes.size(), file) == bytes.size();
+    return std::fclose(file) == 0 && written;
+}
+
+#endif // TEST_SUPPORT_H
@@ -0,0 +1,462 @@
+#include "async_reader.h"
+#include <android/log.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+
+#if defined(__NR_io_uring_setup) && defined(__NR_io_uring_enter)
+#include <linux/io_uring.h>
+#define HAVE_IO_URING 1
+#endif
+
+#define LOG_TAG "AsyncReader"
+#define LOGI(...) __android_log_print(ANDROID_LOG_INFO, LOG_TAG, __VA_ARGS__)
+#define LOGE(...) __android_log_print(ANDROID_LOG_ERROR, LOG_TAG, __VA_ARGS__)
+
+static constexpr size_t kBufferAlignment = 4096;
+static constexpr size_t kIoThreads = 2;
+static constexpr int kRingDrainPolls = 100;
+static constexpr auto kRingDrainInterval = std::chrono::milliseconds(10);
+
+#ifdef HAVE_IO_URING
+
+// Minimal raw-syscall io_uring binding; liburing is not part of the NDK
+struct AsyncReader::IoUring {
+    int fd = -1;
+    void* sqRing = MAP_FAILED;
+    size_t sqRingSize = 0;
+    void* cqRing = MAP_FAILED;
+    size_t cqRingSize = 0;
+    io_uring_sqe* sqes = static_cast<io_uring_sqe*>(MAP_FAILED);
+    size_t sqesSize = 0;
+
+    unsigned* sqTail = nullptr;
+    unsigned* sqMask = nullptr;
+    unsigned* sqArray = nullptr;
+    unsigned* cqHead = nullptr;
+    unsigned* cqTail = nullptr;
+    unsigned* cqMask = nullptr;
+    io_uring_cqe* cqes = nullptr;
+
+    std::vector<iovec> iovecs;
+
+    ~IoUring() {
+        if (sqes != MAP_FAILED) munmap(sqes, sqesSize);
+        if (cqRing != MAP_FAILED) munmap(cqRing, cqRingSize);
+        if (sqRing != MAP_FAILED) munmap(sqRing, sqRingSize);
+        if (fd >= 0) close(fd);
+    }
+};
+
+#else
+
+struct AsyncReader::IoUring {};
+
+#endif
+
+AsyncReader::AsyncReader(const BlockDevice& device, size_t queueDepth, size_t bufferSize)
+    : m_device(device), m_bufferSize(bufferSize), m_nextSubmit(0), m_nextConsume(0),
+      m_holdingSlot(false), m_shutdown(false) {
+    if (m_device.isMapped()) {
+        return; // Blocks come straight from the mapping
+    }
+
+    queueDepth = std::max<size_t>(queueDepth, 2);
+    for (size_t i = 0; i < queueDepth; ++i) {
+        void* memory = nullptr;
+        if (posix_memalign(&memory, kBufferAlignment, m_bufferSize) != 0) {
+            LOGE("Failed to allocate read buffer");
+            break;
+        }
+        m_slots.push_back({std::unique_ptr<uint8_t, void (*)(void*)>(static_cast<uint8_t*>(memory), &free),
+                           0, 0, SlotState::Free});
+    }
+
+    if (!setupIoUring(m_slots.size())) {
+        for (size_t i = 0; i < kIoThreads; ++i) {
+            m_threads.emplace_back(&AsyncReader::workerLoop, this);
+        }
+    }
+}
+
+AsyncReader::~AsyncReader() {
+    // Outstanding reads still target our buffers; let them land first
+    for (size_t i = 0; i < m_slots.size(); ++i) {
+        if (m_slots[i].state == SlotState::Pending) {
+            waitForSlot(i);
+        }
+    }
+    stopWorkers();
+    // The kernel may still write into these after we are gone; leaking them is the safe choice
+    for (auto& buffer : m_retiredBuffers) {
+        buffer.release();
+    }
+}
+
+std::vector<AsyncReader::Request> AsyncReader::splitRange(uint64_t offset, uint64_t length, size_t chunkSize) {
+    std::vector<Request> requests;
+    for (uint64_t done = 0; done < length; done += chunkSize) {
+        requests.push_back({offset + done, (size_t)std::min<uint64_t>(chunkSize, length - done)});
+    }
+    return requests;
+}
+
+void AsyncReader::start(std::vector<Request> requests) {
+    for (size_t i = 0; i < m_slots.size(); ++i) {
+        if (m_slots[i].state == SlotState::Pending) {
+            waitForSlot(i);
+        }
+        m_slots[i].state = SlotState::Free;
+    }
+
+    m_requests = std::move(requests);
+    m_nextSubmit = 0;
+    m_nextConsume = 0;
+    m_holdingSlot = false;
+
+    if (m_device.isMapped()) {
+        if (!m_requests.empty()) {
+            m_device.adviseWillNeed(m_requests[0].offset, m_requests[0].length);
+        }
+        return;
+    }
+
+    for (size_t slot = 0; slot < m_slots.size() && m_nextSubmit < m_requests.size(); ++slot) {
+        submit(slot, m_nextSubmit++);
+    }
+}
+
+bool AsyncReader::next(Block& block) {
+    if (m_device.isMapped()) {
+        if (m_nextConsume >= m_requests.size()) {
+            return false;
+        }
+        const Request& request = m_requests[m_nextConsume++];
+        // Page in the following range while the caller works on this one
+        if (m_nextConsume < m_requests.size()) {
+            m_device.adviseWillNeed(m_requests[m_nextConsume].offset, m_requests[m_nextConsume].length);
+        }
+        uint64_t available = request.offset < m_device.size() ? m_device.size() - request.offset : 0;
+        block.offset = request.offset;
+        block.length = (size_t)std::min<uint64_t>(request.length, available);
+        block.data = m_device.data() + std::min(request.offset, m_device.size());
+        block.complete = block.length == request.length;
+        return true;
+    }
+
+    if (m_slots.empty()) {
+        return false;
+    }
+
+    // The caller is done with the previous block: recycle its buffer for the next read
+    if (m_holdingSlot) {
+        size_t previous = (m_nextConsume - 1) % m_slots.size();
+        m_slots[previous].state = SlotState::Free;
+        if (m_nextSubmit < m_requests.size()) {
+            submit(previous, m_nextSubmit++);
+        }
+        m_holdingSlot = false;
+    }
+
+    if (m_nextConsume >= m_requests.size()) {
+        return false;
+    }
+
+    size_t slotIndex = m_nextConsume % m_slots.size();
+    waitForSlot(slotIndex);
+
+    Slot& slot = m_slots[slotIndex];
+    const Request& request = m_requests[slot.requestIndex];
+    size_t got = slot.result > 0 ? (size_t)slot.result : 0;
+
+    // Finish short or failed asynchronous reads synchronously; they are rare
+    if (got < request.length && request.offset + got < m_device.size()) {
+        long long rest = m_device.read(request.offset + got, slot.buffer.get() + got, request.length - got);
+        if (rest > 0) {
+            got += (size_t)rest;
+        }
+    }
+
+    block.offset = request.offset;
+    block.length = got;
+    block.data = slot.buffer.get();
+    block.complete = got == request.length;
+
+    ++m_nextConsume;
+    m_holdingSlot = true;
+    return true;
+}
+
+void AsyncReader::submit(size_t slotIndex, size_t requestIndex) {
+    Slot& slot = m_slots[slotIndex];
+    slot.requestIndex = requestIndex;
+    slot.result = 0;
+
+    if (m_ring) {
+        slot.state = SlotState::Pending;
+        if (!submitIoUring(slotIndex)) {
+            const Request& request = m_requests[requestIndex];
+            slot.result = m_device.read(request.offset, slot.buffer.get(), request.length);
+            slot.state = SlotState::Ready;
+        }
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        slot.state = SlotState::Pending;
+        m_pending.push_back(slotIndex);
+    }
+    m_workReady.notify_one();
+}
+
+void AsyncReader::waitForSlot(size_t slotIndex) {
+    if (m_ring) {
+        while (m_ring && m_slots[slotIndex].state != SlotState::Ready) {
+            reapIoUring();
+        }
+        if (m_ring) {
+            return;
+        }
+        // The ring failed while we waited and the read went to the pread threads
+    }
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_readDone.wait(lock, [&] { return m_slots[slotIndex].state == SlotState::Ready; });
+}
+
+void AsyncReader::workerLoop() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+
+    while (true) {
+        m_workReady.wait(lock, [&] { return m_shutdown || !m_pending.empty(); });
+        if (m_shutdown) {
+            return;
+        }
+
+        size_t slotIndex = m_pending.front();
+        m_pending.pop_front();
+        Slot& slot = m_slots[slotIndex];
+        const Request request = m_requests[slot.requestIndex];
+
+        lock.unlock();
+        long long result = m_device.read(request.offset, slot.buffer.get(), request.length);
+        lock.lock();
+
+        slot.result = result;
+        slot.state = SlotState::Ready;
+        m_readDone.notify_all();
+    }
+}
+
+void AsyncReader::stopWorkers() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_shutdown = true;
+    }
+    m_workReady.notify_all();
+
+    for (auto& thread : m_threads) {
+        thread.join();
+    }
+    m_threads.clear();
+}
+
+#ifdef HAVE_IO_URING
+
+bool AsyncReader::setupIoUring(size_t queueDepth) {
+    if (m_slots.empty()) {
+        return false;
+    }
+
+    io_uring_params params;
+    memset(&params, 0, sizeof(params));
+
+    int fd = (int)syscall(__NR_io_uring_setup, (unsigned)queueDepth, &params);
+    if (fd < 0) {
+        // ENOSYS on old kernels, EPERM where seccomp blocks it for apps
+        LOGI("io_uring unavailable (%s), using pread threads", strerror(errno));
+        return false;
+    }
+
+    auto ring = std::make_unique<IoUring>();
+    ring->fd = fd;
+    ring->sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    ring->cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    ring->sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+
+    ring->sqRing = mmap(nullptr, ring->sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                        fd, IORING_OFF_SQ_RING);
+    ring->cqRing = mmap(nullptr, ring->cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                        fd, IORING_OFF_CQ_RING);
+    ring->sqes = static_cast<io_uring_sqe*>(mmap(nullptr, ring->sqesSize, PROT_READ | PROT_WRITE,
+                                                 MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES));
+    if (ring->sqRing == MAP_FAILED || ring->cqRing == MAP_FAILED || ring->sqes == MAP_FAILED) {
+        LOGE("Failed to map io_uring rings, using pread threads");
+        return false;
+    }
+
+    uint8_t* sq = static_cast<uint8_t*>(ring->sqRing);
+    uint8_t* cq = static_cast<uint8_t*>(ring->cqRing);
+    ring->sqTail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+    ring->sqMask = reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+    ring->sqArray = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+    ring->cqHead = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+    ring->cqTail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+    ring->cqMask = reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+    ring->cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+
+    ring->iovecs.resize(m_slots.size());
+    for (size_t i = 0; i < m_slots.size(); ++i) {
+        ring->iovecs[i].iov_base = m_slots[i].buffer.get();
+        ring->iovecs[i].iov_len = m_bufferSize;
+    }
+
+    m_ring = std::move(ring);
+    LOGI("Using io_uring with queue depth %zu", queueDepth);
+    return true;
+}
+
+bool AsyncReader::submitIoUring(size_t slotIndex) {
+    IoUring& ring = *m_ring;
+    const Request& request = m_requests[m_slots[slotIndex].requestIndex];
+    ring.iovecs[slotIndex].iov_len = request.length;
+
+    // We are the only producer, so the tail needs no atomic read-modify-write
+    unsigned tail = *ring.sqTail;
+    unsigned index = tail & *ring.sqMask;
+    io_uring_sqe* sqe = &ring.sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = IORING_OP_READV;
+    sqe->fd = m_device.fd();
+    sqe->addr = reinterpret_cast<uint64_t>(&ring.iovecs[slotIndex]);
+    sqe->len = 1;
+    sqe->off = request.offset;
+    sqe->user_data = slotIndex;
+
+    ring.sqArray[index] = index;
+    __atomic_store_n(ring.sqTail, tail + 1, __ATOMIC_RELEASE);
+
+    int submitted;
+    do {
+        submitted = (int)syscall(__NR_io_uring_enter, ring.fd, 1, 0, 0, nullptr, 0);
+    } while (submitted < 0 && errno == EINTR);
+
+    if (submitted != 1) {
+        // Withdraw the entry so the ring stays consistent, then let the caller read inline
+        __atomic_store_n(ring.sqTail, tail, __ATOMIC_RELEASE);
+        return false;
+    }
+    return true;
+}
+
+void AsyncReader::reapIoUring() {
+    IoUring& ring = *m_ring;
+
+    unsigned head = *ring.cqHead;
+    unsigned tail = __atomic_load_n(ring.cqTail, __ATOMIC_ACQUIRE);
+
+    if (head == tail) {
+        int ret = (int)syscall(__NR_io_uring_enter, ring.fd, 0, 1, IORING_ENTER_GETEVENTS, nullptr, 0);
+        if (ret < 0 && errno != EINTR) {
+            LOGE("io_uring wait failed: %s, switching to pread threads", strerror(errno));
+            abandonIoUring();
+        }
+        return;
+    }
+
+    for (; head != tail; ++head) {
+        const io_uring_cqe& cqe = ring.cqes[head & *ring.cqMask];
+        Slot& slot = m_slots[(size_t)cqe.user_data];
+        slot.result = cqe.res; // negative errno is finished by the synchronous retry in next()
+        slot.state = SlotState::Ready;
+    }
+    __atomic_store_n(ring.cqHead, head, __ATOMIC_RELEASE);
+}
+
+void AsyncReader::abandonIoUring() {
+    IoUring& ring = *m_ring;
+
+    std::vector<bool> inFlight(m_slots.size());
+    size_t outstanding = 0;
+    for (size_t i = 0; i < m_slots.size(); ++i) {
+        inFlight[i] = m_slots[i].state == SlotState::Pending;
+        outstanding += inFlight[i];
+    }
+
+    // Completions still reach the CQ ring without io_uring_enter
+    auto drain = [&] {
+        unsigned head = *ring.cqHead;
+        unsigned tail = __atomic_load_n(ring.cqTail, __ATOMIC_ACQUIRE);
+        for (; head != tail; ++head) {
+            size_t slotIndex = (size_t)ring.cqes[head & *ring.cqMask].user_data;
+            if (inFlight[slotIndex]) {
+                inFlight[slotIndex] = false;
+                --outstanding;
+            }
+        }
+        __atomic_store_n(ring.cqHead, head, __ATOMIC_RELEASE);
+    };
+
+    // Give outstanding reads a moment to land before deciding which buffers to give up
+    for (int poll = 0; poll < kRingDrainPolls; ++poll) {
+        drain();
+        if (outstanding == 0) {
+            break;
+        }
+        std::this_thread::sleep_for(kRingDrainInterval);
+    }
+
+    // Reads that never completed keep their buffers; the slots get fresh ones
+    for (size_t i = 0; i < m_slots.size(); ++i) {
+        if (!inFlight[i]) {
+            continue;
+        }
+        void* memory = nullptr;
+        if (posix_memalign(&memory, kBufferAlignment, m_bufferSize) != 0) {
+            // No replacement: this buffer can only be reused once its read is done
+            LOGE("Failed to replace read buffer, waiting for its read");
+            while (inFlight[i]) {
+                std::this_thread::sleep_for(kRingDrainInterval);
+                drain();
+            }
+            continue;
+        }
+        m_retiredBuffers.push_back(std::move(m_slots[i].buffer));
+        m_slots[i].buffer.reset(static_cast<uint8_t*>(memory));
+    }
+
+    m_ring.reset();
+    for (size_t i = 0; i < kIoThreads; ++i) {
+        m_threads.emplace_back(&AsyncReader::workerLoop, this);
+    }
+
+    // Every read the caller is still waiting for is issued again through the threads
+    for (size_t i = 0; i < m_slots.size(); ++i) {
+        if (m_slots[i].state == SlotState::Pending) {
+            submit(i, m_slots[i].requestIndex);
+        }
+    }
+}
+
+#else
+
+bool AsyncReader::setupIoUring(size_t) {
+    return false;
+}
+
+bool AsyncReader::submitIoUring(size_t) {
+    return false;
+}
+
+void AsyncReader::reapIoUring() {}
+
+void AsyncReader::abandonIoUring() {}
+
+#endif
@@ -0,0 +1,96 @@
+#ifndef ASYNC_READER_H
+#define ASYNC_READER_H
+
+#include "block_device.h"
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Read-ahead pipeline over a BlockDevice.
+// A list of ranges is read strictly in order while up to queueDepth - 1 further reads
+// stay queued against the device, so parsing the current buffer overlaps with I/O.
+// Reads go through io_uring when the kernel (and seccomp policy) allows it and through a
+// small pool of pread threads otherwise. Mapped images need no I/O at all: blocks then
+// point straight into the mapping.
+class AsyncReader {
+public:
+    struct Request {
+        uint64_t offset;
+        size_t length;
+    };
+
+    struct Block {
+        uint64_t offset;
+        size_t length;     // bytes actually available at data
+        const uint8_t* data;
+        bool complete;     // false if the device returned fewer bytes than requested
+    };
+
+    AsyncReader(const BlockDevice& device, size_t queueDepth, size_t bufferSize);
+    ~AsyncReader();
+
+    AsyncReader(const AsyncReader&) = delete;
+    AsyncReader& operator=(const AsyncReader&) = delete;
+
+    // Queues requests (each at most bufferSize bytes) and starts reading ahead
+    void start(std::vector<Request> requests);
+
+    // Waits for the next request in order. The block stays valid until the next call.
+    // Returns false once every request has been consumed.
+    bool next(Block& block);
+
+    bool usingIoUring() const { return m_ring != nullptr; }
+    const BlockDevice& device() const { return m_device; }
+
+    // Splits [offset, offset + length) into requests of at most chunkSize bytes
+    static std::vector<Request> splitRange(uint64_t offset, uint64_t length, size_t chunkSize);
+
+private:
+    enum class SlotState { Free, Pending, Ready };
+
+    struct Slot {
+        std::unique_ptr<uint8_t, void (*)(void*)> buffer;
+        size_t requestIndex;
+        long long result;
+        SlotState state;
+    };
+
+    struct IoUring;
+
+    const BlockDevice& m_device;
+    size_t m_bufferSize;
+    std::vector<Slot> m_slots;
+    std::vector<Request> m_requests;
+    size_t m_nextSubmit;
+    size_t m_nextConsume;
+    bool m_holdingSlot;
+
+    std::unique_ptr<IoUring> m_ring;
+    // Buffers a failed ring may still be reading into; never reused or freed
+    std::vector<std::unique_ptr<uint8_t, void (*)(void*)>> m_retiredBuffers;
+
+    // pread fallback
+    std::vector<std::thread> m_threads;
+    std::mutex m_mutex;
+    std::condition_variable m_workReady;
+    std::condition_variable m_readDone;
+    std::deque<size_t> m_pending;
+    bool m_shutdown;
+
+    void submit(size_t slotIndex, size_t requestIndex);
+    void waitForSlot(size_t slotIndex);
+    void workerLoop();
+    void stopWorkers();
+
+    bool setupIoUring(size_t queueDepth);
+    bool submitIoUring(size_t slotIndex);
+    void reapIoUring();
+    void abandonIoUring();
+};
+
+#endif // ASYNC_READER_H
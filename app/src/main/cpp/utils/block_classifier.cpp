@@ -0,0 +1,155 @@
+#include "block_classifier.h"
+#include <cmath>
+
+#if defined(__aarch64__)
+#include <arm_neon.h>
+#elif defined(__x86_64__)
+#include <emmintrin.h>
+#endif
+
+namespace {
+
+// c * log2(c) for every count a block can produce, so entropy needs no log calls
+struct CountLogTable {
+    float values[BlockClassifier::kBlockSize + 1];
+
+    CountLogTable() {
+        values[0] = 0.0f;
+        for (size_t c = 1; c <= BlockClassifier::kBlockSize; ++c) {
+            values[c] = (float)((double)c * std::log2((double)c));
+        }
+    }
+};
+
+const CountLogTable s_countLog;
+
+inline bool isTextByte(uint8_t byte) {
+    return (byte >= 0x20 && byte < 0x7F) || byte == '\t' || byte == '\n' || byte == '\r';
+}
+
+} // namespace
+
+bool BlockClassifier::isZero(const uint8_t* data, size_t length) {
+    size_t i = 0;
+#if defined(__aarch64__)
+    uint8x16_t any = vdupq_n_u8(0);
+    for (; i + 64 <= length; i += 64) {
+        any = vorrq_u8(any, vorrq_u8(vorrq_u8(vld1q_u8(data + i), vld1q_u8(data + i + 16)),
+                                     vorrq_u8(vld1q_u8(data + i + 32), vld1q_u8(data + i + 48))));
+    }
+    if (vmaxvq_u8(any) != 0) {
+        return false;
+    }
+#elif defined(__x86_64__)
+    __m128i any = _mm_setzero_si128();
+    for (; i + 64 <= length; i += 64) {
+        const __m128i* p = reinterpret_cast<const __m128i*>(data + i);
+        any = _mm_or_si128(any, _mm_or_si128(_mm_or_si128(_mm_loadu_si128(p), _mm_loadu_si128(p + 1)),
+                                             _mm_or_si128(_mm_loadu_si128(p + 2), _mm_loadu_si128(p + 3))));
+    }
+    if (_mm_movemask_epi8(_mm_cmpeq_epi8(any, _mm_setzero_si128())) != 0xFFFF) {
+        return false;
+    }
+#endif
+    for (; i < length; ++i) {
+        if (data[i] != 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+size_t BlockClassifier::countText(const uint8_t* data, size_t length) {
+    size_t count = 0;
+    size_t i = 0;
+#if defined(__aarch64__)
+    const uint8x16_t space = vdupq_n_u8(0x20);
+    const uint8x16_t printableSpan = vdupq_n_u8(0x7F - 0x20);
+    const uint8x16_t tab = vdupq_n_u8('\t');
+    const uint8x16_t newline = vdupq_n_u8('\n');
+    const uint8x16_t carriageReturn = vdupq_n_u8('\r');
+    // Each step adds at most 2 to a 16-bit lane; flush long before that can overflow
+    uint16x8_t total = vdupq_n_u16(0);
+    size_t steps = 0;
+    for (; i + 16 <= length; i += 16) {
+        uint8x16_t bytes = vld1q_u8(data + i);
+        uint8x16_t text = vcltq_u8(vsubq_u8(bytes, space), printableSpan);
+        text = vorrq_u8(text, vceqq_u8(bytes, tab));
+        text = vorrq_u8(text, vceqq_u8(bytes, newline));
+        text = vorrq_u8(text, vceqq_u8(bytes, carriageReturn));
+        total = vpadalq_u8(total, vshrq_n_u8(text, 7));
+        if (++steps == 4096) {
+            steps = 0;
+            count += vaddvq_u16(total);
+            total = vdupq_n_u16(0);
+        }
+    }
+    count += vaddvq_u16(total);
+#elif defined(__x86_64__)
+    // 0x20..0x7E are exactly the signed bytes in (0x1F, 0x7F)
+    const __m128i belowPrintable = _mm_set1_epi8(0x1F);
+    const __m128i deleteByte = _mm_set1_epi8(0x7F);
+    const __m128i tab = _mm_set1_epi8('\t');
+    const __m128i newline = _mm_set1_epi8('\n');
+    const __m128i carriageReturn = _mm_set1_epi8('\r');
+    for (; i + 16 <= length; i += 16) {
+        __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+        __m128i text = _mm_and_si128(_mm_cmpgt_epi8(bytes, belowPrintable), _mm_cmplt_epi8(bytes, deleteByte));
+        text = _mm_or_si128(text, _mm_cmpeq_epi8(bytes, tab));
+        text = _mm_or_si128(text, _mm_cmpeq_epi8(bytes, newline));
+        text = _mm_or_si128(text, _mm_cmpeq_epi8(bytes, carriageReturn));
+        count += (size_t)__builtin_popcount((unsigned)_mm_movemask_epi8(text));
+    }
+#endif
+    for (; i < length; ++i) {
+        count += isTextByte(data[i]) ? 1 : 0;
+    }
+    return count;
+}
+
+float BlockClassifier::entropy(const uint8_t* data, size_t length) {
+    if (length == 0) {
+        return 0.0f;
+    }
+    if (length > kBlockSize) {
+        length = kBlockSize;
+    }
+
+    // Four tables so consecutive equal bytes do not serialize on one counter
+    uint16_t counts[4][256] = {};
+    size_t i = 0;
+    for (; i + 4 <= length; i += 4) {
+        ++counts[0][data[i]];
+        ++counts[1][data[i + 1]];
+        ++counts[2][data[i + 2]];
+        ++counts[3][data[i + 3]];
+    }
+    for (; i < length; ++i) {
+        ++counts[0][data[i]];
+    }
+
+    // H = log2(n) - sum(c * log2(c)) / n
+    float sum = 0.0f;
+    for (int byte = 0; byte < 256; ++byte) {
+        sum += s_countLog.values[counts[0][byte] + counts[1][byte] + counts[2][byte] + counts[3][byte]];
+    }
+    const float n = (float)length;
+    return s_countLog.values[length] / n - sum / n;
+}
+
+BlockStats BlockClassifier::classify(const uint8_t* data, size_t length) {
+    if (length > kBlockSize) {
+        length = kBlockSize;
+    }
+    if (length == 0 || isZero(data, length)) {
+        return {BlockClass::Zero, 0.0f, 0.0f};
+    }
+
+    const float textFraction = (float)countText(data, length) / (float)length;
+    if (textFraction >= kTextFraction) {
+        return {BlockClass::Text, 0.0f, textFraction};
+    }
+
+    const float bits = entropy(data, length);
+    return {bits >= kRandomEntropy ? BlockClass::Random : BlockClass::Structured, bits, textFraction};
+}
@@ -0,0 +1,40 @@
+#ifndef BLOCK_CLASSIFIER_H
+#define BLOCK_CLASSIFIER_H
+
+#include <cstddef>
+#include <cstdint>
+
+enum class BlockClass : uint8_t {
+    Structured, // mixed binary data: headers, tables, uncompressed media
+    Zero,       // every byte is zero (trimmed or never written)
+    Text,       // almost entirely printable ASCII and line breaks
+    Random,     // near maximal entropy: compressed or encrypted
+};
+
+struct BlockStats {
+    BlockClass type;
+    float entropy;      // Shannon entropy in bits per byte; 0 when not computed
+    float textFraction; // share of printable ASCII, tab, CR and LF bytes
+};
+
+// Classifies filesystem blocks by byte statistics, so carving can pass over blocks no
+// file signature can start in. On file-based encrypted userdata most free blocks are
+// ciphertext, which looks like uniform random bytes.
+// The zero test and the text count run on NEON or SSE2; the byte histogram for the
+// entropy uses four interleaved tables, as scattered increments do not vectorize.
+class BlockClassifier {
+public:
+    static constexpr size_t kBlockSize = 4096;
+    // A uniformly random 4 KiB block measures about 7.95 bits per byte
+    static constexpr float kRandomEntropy = 7.9f;
+    static constexpr float kTextFraction = 0.95f;
+
+    // length is at most kBlockSize; shorter tails are classified on what is there
+    static BlockStats classify(const uint8_t* data, size_t length);
+
+    static bool isZero(const uint8_t* data, size_t length);
+    static size_t countText(const uint8_t* data, size_t length);
+    static float entropy(const uint8_t* data, size_t length);
+};
+
+#endif // BLOCK_CLASSIFIER_H
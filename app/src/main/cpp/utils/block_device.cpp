@@ -0,0 +1,150 @@
+#include "block_device.h"
+#include <android/log.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <cerrno>
+#include <cstring>
+#include <algorithm>
+
+#define LOG_TAG "BlockDevice"
+#define LOGI(...) __android_log_print(ANDROID_LOG_INFO, LOG_TAG, __VA_ARGS__)
+#define LOGE(...) __android_log_print(ANDROID_LOG_ERROR, LOG_TAG, __VA_ARGS__)
+
+BlockDevice::BlockDevice() : m_fd(-1), m_size(0), m_map(nullptr) {}
+
+BlockDevice::~BlockDevice() {
+    close();
+}
+
+bool BlockDevice::open(const std::string& path, bool allowMapping) {
+    close();
+
+    m_fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC | O_LARGEFILE);
+    if (m_fd < 0) {
+        LOGE("Failed to open %s: %s", path.c_str(), strerror(errno));
+        return false;
+    }
+
+    // lseek to the end works for both block devices and regular image files
+    off64_t end = lseek64(m_fd, 0, SEEK_END);
+    if (end < 0) {
+        LOGE("Failed to determine size of %s: %s", path.c_str(), strerror(errno));
+        close();
+        return false;
+    }
+
+    m_size = static_cast<uint64_t>(end);
+    m_path = path;
+
+    // Only image files are mapped; block devices keep going through pread
+    struct stat st;
+    if (allowMapping && m_size > 0 && m_size <= SIZE_MAX && fstat(m_fd, &st) == 0 && S_ISREG(st.st_mode)) {
+        void* map = mmap(nullptr, static_cast<size_t>(m_size), PROT_READ, MAP_SHARED, m_fd, 0);
+        if (map != MAP_FAILED) {
+            m_map = static_cast<uint8_t*>(map);
+        } else {
+            // Typically a large image on a 32-bit ABI; pread still works
+            LOGI("Mapping %s failed (%s), falling back to pread", path.c_str(), strerror(errno));
+        }
+    }
+
+    LOGI("Opened %s (%llu bytes, %s)", path.c_str(), (unsigned long long)m_size,
+         m_map ? "mapped" : "pread");
+    return true;
+}
+
+void BlockDevice::close() {
+    if (m_map) {
+        munmap(m_map, static_cast<size_t>(m_size));
+        m_map = nullptr;
+    }
+    if (m_fd >= 0) {
+        ::close(m_fd);
+    }
+    m_fd = -1;
+    m_size = 0;
+    m_path.clear();
+}
+
+long long BlockDevice::read(uint64_t offset, void* buffer, size_t length) const {
+    if (m_fd < 0) {
+        return -1;
+    }
+
+    if (m_map) {
+        if (offset >= m_size) {
+            return 0;
+        }
+        size_t available = static_cast<size_t>(std::min<uint64_t>(length, m_size - offset));
+        memcpy(buffer, m_map + offset, available);
+        return static_cast<long long>(available);
+    }
+
+    uint8_t* out = static_cast<uint8_t*>(buffer);
+    size_t total = 0;
+
+    while (total < length) {
+        ssize_t n = pread64(m_fd, out + total, length - total, static_cast<off64_t>(offset + total));
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            LOGE("Read of %zu bytes at %llu failed: %s", length - total,
+                 (unsigned long long)(offset + total), strerror(errno));
+            return -1;
+        }
+        if (n == 0) {
+            break; // End of device
+        }
+        total += static_cast<size_t>(n);
+    }
+
+    return static_cast<long long>(total);
+}
+
+const uint8_t* BlockDevice::view(uint64_t offset, size_t length, std::vector<uint8_t>& scratch) const {
+    if (offset > m_size || length > m_size - offset) {
+        return nullptr;
+    }
+
+    if (m_map) {
+        return m_map + offset;
+    }
+
+    scratch.resize(length);
+    if (read(offset, scratch.data(), length) != static_cast<long long>(length)) {
+        return nullptr;
+    }
+    return scratch.data();
+}
+
+void BlockDevice::adviseSequential(uint64_t offset, uint64_t length) const {
+    if (m_map) {
+        adviseMapping(offset, length, MADV_SEQUENTIAL);
+    } else if (m_fd >= 0) {
+        posix_fadvise64(m_fd, static_cast<off64_t>(offset), static_cast<off64_t>(length),
+                        POSIX_FADV_SEQUENTIAL);
+    }
+}
+
+void BlockDevice::adviseWillNeed(uint64_t offset, uint64_t length) const {
+    if (m_map) {
+        adviseMapping(offset, length, MADV_WILLNEED);
+    } else if (m_fd >= 0) {
+        posix_fadvise64(m_fd, static_cast<off64_t>(offset), static_cast<off64_t>(length),
+                        POSIX_FADV_WILLNEED);
+    }
+}
+
+void BlockDevice::adviseMapping(uint64_t offset, uint64_t length, int advice) const {
+    if (offset >= m_size) {
+        return;
+    }
+    // madvise needs a page-aligned start address
+    const uint64_t pageSize = static_cast<uint64_t>(sysconf(_SC_PAGESIZE));
+    uint64_t alignedStart = offset & ~(pageSize - 1);
+    uint64_t end = std::min(m_size, offset + length);
+    madvise(m_map + alignedStart, static_cast<size_t>(end - alignedStart), advice);
+}
@@ -0,0 +1,52 @@
+#ifndef BLOCK_DEVICE_H
+#define BLOCK_DEVICE_H
+
+#include <string>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+// Read-only view of a raw partition or disk image.
+// Regular image files (e.g. dd dumps analysed offline) are memory-mapped so scanners can
+// parse structures in place; block devices, and images too large to map, use pread.
+class BlockDevice {
+public:
+    BlockDevice();
+    ~BlockDevice();
+
+    BlockDevice(const BlockDevice&) = delete;
+    BlockDevice& operator=(const BlockDevice&) = delete;
+
+    bool open(const std::string& path, bool allowMapping = true);
+    void close();
+
+    bool isOpen() const { return m_fd >= 0; }
+    bool isMapped() const { return m_map != nullptr; }
+    int fd() const { return m_fd; }
+    uint64_t size() const { return m_size; }
+    const std::string& path() const { return m_path; }
+
+    // Start of the mapping, or nullptr when the device is accessed with pread
+    const uint8_t* data() const { return m_map; }
+
+    // Reads up to length bytes at offset, retrying short reads.
+    // Returns the number of bytes read, or -1 on error.
+    long long read(uint64_t offset, void* buffer, size_t length) const;
+
+    // Returns a pointer to length bytes at offset: straight into the mapping when mapped,
+    // otherwise read into scratch. Returns nullptr if the range cannot be read in full.
+    const uint8_t* view(uint64_t offset, size_t length, std::vector<uint8_t>& scratch) const;
+
+    void adviseSequential(uint64_t offset, uint64_t length) const;
+    void adviseWillNeed(uint64_t offset, uint64_t length) const;
+
+private:
+    int m_fd;
+    uint64_t m_size;
+    std::string m_path;
+    uint8_t* m_map;
+
+    void adviseMapping(uint64_t offset, uint64_t length, int advice) const;
+};
+
+#endif // BLOCK_DEVICE_H
@@ -0,0 +1,32 @@
+#ifndef BYTE_ORDER_H
+#define BYTE_ORDER_H
+
+#include <cstdint>
+
+// On-disk structures of ext4, F2FS and FAT are little-endian, while most media formats
+// (JPEG, PNG, MP4) are big-endian; these read fields in place without alignment assumptions.
+inline uint16_t readLe16(const uint8_t* p) {
+    return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+inline uint32_t readLe32(const uint8_t* p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+inline uint64_t readLe64(const uint8_t* p) {
+    return (uint64_t)readLe32(p) | ((uint64_t)readLe32(p + 4) << 32);
+}
+
+inline uint16_t readBe16(const uint8_t* p) {
+    return (uint16_t)((p[0] << 8) | p[1]);
+}
+
+inline uint32_t readBe32(const uint8_t* p) {
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | (uint32_t)p[3];
+}
+
+inline uint64_t readBe64(const uint8_t* p) {
+    return ((uint64_t)readBe32(p) << 32) | (uint64_t)readBe32(p + 4);
+}
+
+#endif // BYTE_ORDER_H
@@ -0,0 +1,181 @@
+#include "extension_classifier.h"
+#include <cstdint>
+
+namespace {
+
+struct KnownExtension {
+    const char* extension; // lower case, at most kMaxExtensionLength characters
+    int fileType;
+};
+
+constexpr KnownExtension kExtensions[] = {
+    // Photos, including camera raw formats
+    {"jpg", 1}, {"jpeg", 1}, {"jpe", 1}, {"jfif", 1}, {"png", 1}, {"gif", 1}, {"bmp", 1},
+    {"webp", 1}, {"heic", 1}, {"heif", 1}, {"avif", 1}, {"tif", 1}, {"tiff", 1}, {"jxl", 1},
+    {"ico", 1}, {"svg", 1}, {"psd", 1}, {"dng", 1}, {"cr2", 1}, {"cr3", 1}, {"nef", 1},
+    {"arw", 1}, {"orf", 1}, {"rw2", 1}, {"raf", 1}, {"srw", 1}, {"pef", 1},
+    // Videos
+    {"mp4", 2}, {"m4v", 2}, {"avi", 2}, {"mov", 2}, {"mkv", 2}, {"3gp", 2}, {"3g2", 2},
+    {"flv", 2}, {"f4v", 2}, {"wmv", 2}, {"asf", 2}, {"webm", 2}, {"mpg", 2}, {"mpeg", 2},
+    {"ts", 2}, {"mts", 2}, {"m2ts", 2}, {"vob", 2}, {"ogv", 2}, {"rm", 2}, {"rmvb", 2},
+    {"divx", 2},
+    // Documents, e-books and text
+    {"pdf", 3}, {"doc", 3}, {"docx", 3}, {"docm", 3}, {"dot", 3}, {"dotx", 3}, {"xls", 3},
+    {"xlsx", 3}, {"xlsm", 3}, {"ppt", 3}, {"pptx", 3}, {"pps", 3}, {"ppsx", 3}, {"odt", 3},
+    {"ods", 3}, {"odp", 3}, {"odg", 3}, {"rtf", 3}, {"txt", 3}, {"csv", 3}, {"md", 3},
+    {"html", 3}, {"htm", 3}, {"xml", 3}, {"json", 3}, {"tex", 3}, {"epub", 3}, {"mobi", 3},
+    {"azw", 3}, {"azw3", 3}, {"fb2", 3}, {"djvu", 3}, {"xps", 3}, {"pages", 3},
+    {"numbers", 3}, {"key", 3},
+    // Audio
+    {"mp3", 4}, {"wav", 4}, {"aac", 4}, {"flac", 4}, {"ogg", 4}, {"oga", 4}, {"opus", 4},
+    {"m4a", 4}, {"m4b", 4}, {"wma", 4}, {"amr", 4}, {"awb", 4}, {"3ga", 4}, {"mid", 4},
+    {"midi", 4}, {"aif", 4}, {"aiff", 4}, {"ape", 4}, {"wv", 4}, {"mka", 4},
+    // Archives
+    {"zip", 5}, {"rar", 5}, {"7z", 5}, {"tar", 5}, {"gz", 5}, {"tgz", 5}, {"bz2", 5},
+    {"tbz2", 5}, {"xz", 5}, {"txz", 5}, {"zst", 5}, {"lz4", 5}, {"lzma", 5}, {"cab", 5},
+    {"iso", 5}, {"jar", 5},
+    // Android packages and app bundles
+    {"apk", 6}, {"apks", 6}, {"xapk", 6}, {"apkm", 6}, {"aab", 6},
+};
+
+constexpr size_t kExtensionCount = sizeof(kExtensions) / sizeof(kExtensions[0]);
+
+// Hash and displace: keys are split into buckets by one hash, then each bucket gets the
+// smallest displacement that moves all of its keys into free slots under a second hash.
+// Buckets are placed largest first, which is what keeps the displacements small.
+constexpr unsigned kBucketBits = 6;
+constexpr unsigned kSlotBits = 8;
+constexpr size_t kBucketCount = size_t(1) << kBucketBits;
+constexpr size_t kSlotCount = size_t(1) << kSlotBits;
+constexpr uint32_t kMaxDisplacement = 0xFFFF;
+
+static_assert(kExtensionCount * 3 / 2 <= kSlotCount, "extension table is too full");
+
+// Packs an extension into a key, or returns 0 if it is not a plausible extension.
+// Folding is an OR with 0x20, which leaves digits unchanged and lower-cases letters.
+constexpr uint64_t packExtension(const char* extension, size_t length) {
+    if (length == 0 || length > ExtensionClassifier::kMaxExtensionLength) {
+        return 0;
+    }
+    uint64_t key = 0;
+    for (size_t i = 0; i < length; ++i) {
+        uint8_t c = static_cast<uint8_t>(extension[i]);
+        if (c >= 'A' && c <= 'Z') {
+            c |= 0x20;
+        } else if (!((c >= 'a' && c <= 'z') || (c >= '0' && c <= '9'))) {
+            return 0;
+        }
+        key |= static_cast<uint64_t>(c) << (8 * i);
+    }
+    return key;
+}
+
+constexpr size_t constLength(const char* text) {
+    size_t length = 0;
+    while (text[length] != '\0') {
+        ++length;
+    }
+    return length;
+}
+
+constexpr uint64_t mix(uint64_t value) {
+    value ^= value >> 33;
+    value *= 0xFF51AFD7ED558CCDULL;
+    value ^= value >> 33;
+    return value;
+}
+
+constexpr size_t bucketOf(uint64_t key) {
+    return static_cast<size_t>(mix(key) >> (64 - kBucketBits));
+}
+
+constexpr size_t slotOf(uint64_t key, uint32_t displacement) {
+    return static_cast<size_t>((mix(key + displacement * 0x9E3779B97F4A7C15ULL) *
+                                0xC4CEB9FE1A85EC53ULL) >> (64 - kSlotBits));
+}
+
+struct ExtensionTable {
+    uint64_t keys[kSlotCount]; // 0 marks an empty slot
+    uint8_t types[kSlotCount];
+    uint16_t displacement[kBucketCount];
+    bool complete;             // every extension was placed exactly once
+};
+
+constexpr bool placeBucket(ExtensionTable& table, size_t bucket, uint32_t displacement) {
+    for (size_t i = 0; i < kExtensionCount; ++i) {
+        const uint64_t key = packExtension(kExtensions[i].extension, constLength(kExtensions[i].extension));
+        if (bucketOf(key) != bucket) {
+            continue;
+        }
+        const size_t slot = slotOf(key, displacement);
+        if (table.keys[slot] != 0) {
+            // Undo this bucket's placements so far; duplicates in the list land here too
+            for (size_t j = 0; j < i; ++j) {
+                const uint64_t placed = packExtension(kExtensions[j].extension,
+                                                      constLength(kExtensions[j].extension));
+                if (bucketOf(placed) == bucket && table.keys[slotOf(placed, displacement)] == placed) {
+                    table.keys[slotOf(placed, displacement)] = 0;
+                    table.types[slotOf(placed, displacement)] = 0;
+                }
+            }
+            return false;
+        }
+        table.keys[slot] = key;
+        table.types[slot] = static_cast<uint8_t>(kExtensions[i].fileType);
+    }
+    return true;
+}
+
+constexpr ExtensionTable buildExtensionTable() {
+    ExtensionTable table{};
+    size_t bucketSize[kBucketCount] = {};
+    size_t largest = 0;
+    for (size_t i = 0; i < kExtensionCount; ++i) {
+        const uint64_t key = packExtension(kExtensions[i].extension, constLength(kExtensions[i].extension));
+        if (key == 0) {
+            return table; // not packable; complete stays false
+        }
+        const size_t size = ++bucketSize[bucketOf(key)];
+        largest = size > largest ? size : largest;
+    }
+
+    for (size_t size = largest; size > 0; --size) {
+        for (size_t bucket = 0; bucket < kBucketCount; ++bucket) {
+            if (bucketSize[bucket] != size) {
+                continue;
+            }
+            uint32_t displacement = 0;
+            while (!placeBucket(table, bucket, displacement)) {
+                if (++displacement > kMaxDisplacement) {
+                    return table;
+                }
+            }
+            table.displacement[bucket] = static_cast<uint16_t>(displacement);
+        }
+    }
+    table.complete = true;
+    return table;
+}
+
+constexpr ExtensionTable kTable = buildExtensionTable();
+
+static_assert(kTable.complete, "extension list has an invalid or duplicate entry");
+
+} // namespace
+
+int ExtensionClassifier::classify(const char* extension, size_t length) {
+    const uint64_t key = packExtension(extension, length);
+    if (key == 0) {
+        return 0; // OTHER
+    }
+    const size_t slot = slotOf(key, kTable.displacement[bucketOf(key)]);
+    return kTable.keys[slot] == key ? kTable.types[slot] : 0;
+}
+
+int ExtensionClassifier::classifyFileName(const std::string& fileName) {
+    const size_t dotPos = fileName.find_last_of('.');
+    if (dotPos == std::string::npos) {
+        return 0; // OTHER
+    }
+    return classify(fileName.data() + dotPos + 1, fileName.size() - dotPos - 1);
+}
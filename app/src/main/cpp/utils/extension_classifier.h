@@ -0,0 +1,22 @@
+#ifndef EXTENSION_CLASSIFIER_H
+#define EXTENSION_CLASSIFIER_H
+
+#include <cstddef>
+#include <string>
+
+// Maps a file name extension to a file type (1 photo, 2 video, 3 document, 4 audio,
+// 5 archive, 6 APK, 0 other). Extensions are packed into a 64-bit key with letters folded
+// to lower case on the fly and looked up in a perfect hash table built at compile time,
+// so a lookup costs two multiplies and one compare whatever the table size.
+class ExtensionClassifier {
+public:
+    // extension excludes the dot and need not be NUL terminated
+    static int classify(const char* extension, size_t length);
+    // Classifies by the text after the last '.', or returns 0 if there is none
+    static int classifyFileName(const std::string& fileName);
+
+    // Longer extensions cannot be packed into a key and are never known
+    static constexpr size_t kMaxExtensionLength = 8;
+};
+
+#endif // EXTENSION_CLASSIFIER_H
@@ -0,0 +1,72 @@
+#include "extent_list.h"
+#include <cstring>
+
+void ExtentList::addRun(uint64_t offset, uint64_t length) {
+    if (length == 0) {
+        return;
+    }
+    if (!m_extents.empty()) {
+        FileExtent& last = m_extents.back();
+        if ((uint64_t)(last.offset + last.length) == offset) {
+            last.length += (long long)length;
+            m_totalLength += length;
+            return;
+        }
+    }
+    m_extents.push_back({(long long)offset, (long long)length});
+    m_totalLength += length;
+}
+
+static inline bool testBit(const uint8_t* bitmap, size_t bit, bool msbFirst) {
+    uint8_t mask = msbFirst ? (uint8_t)(0x80 >> (bit & 7)) : (uint8_t)(1 << (bit & 7));
+    return (bitmap[bit >> 3] & mask) != 0;
+}
+
+// Returns the first bit at or after bit that equals value, or bitCount if there is none
+static size_t findBit(const uint8_t* bitmap, size_t bit, size_t bitCount, bool value, bool msbFirst) {
+    const uint8_t skipByte = value ? 0x00 : 0xFF;
+    const uint64_t skipWord = value ? 0 : ~0ULL;
+
+    while (bit < bitCount) {
+        // Fully allocated or fully free stretches are the common case: step over them a
+        // word, then a byte, at a time
+        while ((bit & 7) == 0 && bit + 8 <= bitCount) {
+            if ((bit & 63) == 0 && bit + 64 <= bitCount) {
+                uint64_t word;
+                memcpy(&word, bitmap + (bit >> 3), sizeof(word));
+                if (word == skipWord) {
+                    bit += 64;
+                    continue;
+                }
+            }
+            if (bitmap[bit >> 3] != skipByte) {
+                break;
+            }
+            bit += 8;
+        }
+        if (bit >= bitCount) {
+            break;
+        }
+
+        if (testBit(bitmap, bit, msbFirst) == value) {
+            return bit;
+        }
+        ++bit;
+    }
+    return bitCount;
+}
+
+void ExtentList::addClearBits(const uint8_t* bitmap, size_t bitCount, uint64_t firstUnit,
+                              uint64_t unitSize, bool msbFirst) {
+    size_t bit = findBit(bitmap, 0, bitCount, false, msbFirst);
+    while (bit < bitCount) {
+        size_t end = findBit(bitmap, bit, bitCount, true, msbFirst);
+        addRun((firstUnit + bit) * unitSize, (uint64_t)(end - bit) * unitSize);
+        bit = findBit(bitmap, end, bitCount, false, msbFirst);
+    }
+}
+
+std::vector<FileExtent> ExtentList::release() {
+    m_totalLength = 0;
+    return std::move(m_extents);
+}
@@ -0,0 +1,33 @@
+#ifndef EXTENT_LIST_H
+#define EXTENT_LIST_H
+
+#include "../include/native_scanner.h"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Builds a sorted list of device byte ranges from allocation maps.
+// Runs must be added in ascending order; adjacent runs are merged as they arrive, so a
+// mostly free filesystem yields a few long extents rather than one per block.
+class ExtentList {
+public:
+    ExtentList() : m_totalLength(0) {}
+
+    void addRun(uint64_t offset, uint64_t length);
+
+    // Adds the runs of clear bits in an allocation bitmap; bit i stands for the unit at
+    // byte offset (firstUnit + i) * unitSize. ext4 numbers bits from the least significant
+    // end of each byte, F2FS from the most significant end.
+    void addClearBits(const uint8_t* bitmap, size_t bitCount, uint64_t firstUnit,
+                      uint64_t unitSize, bool msbFirst);
+
+    const std::vector<FileExtent>& extents() const { return m_extents; }
+    uint64_t totalLength() const { return m_totalLength; }
+    std::vector<FileExtent> release();
+
+private:
+    std::vector<FileExtent> m_extents;
+    uint64_t m_totalLength;
+};
+
+#endif // EXTENT_LIST_H
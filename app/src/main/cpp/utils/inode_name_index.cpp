@@ -0,0 +1,102 @@
+#include "inode_name_index.h"
+
+// Directory depth beyond which a parent chain is treated as a loop
+static constexpr int kMaxPathDepth = 128;
+static constexpr size_t kInitialSlots = 1024;
+
+InodeNameIndex::InodeNameIndex(size_t maxEntries)
+    : m_slots(kInitialSlots, Slot{0, 0, 0}), m_count(0), m_maxEntries(maxEntries) {}
+
+size_t InodeNameIndex::home(uint32_t inode) const {
+    // Fibonacci hashing spreads the runs of consecutive inode numbers a directory holds
+    return (size_t)((inode * 0x9E3779B97F4A7C15ULL) >> 32) & (m_slots.size() - 1);
+}
+
+const InodeNameIndex::Slot* InodeNameIndex::findSlot(uint32_t inode) const {
+    if (inode == 0) {
+        return nullptr;
+    }
+    const size_t mask = m_slots.size() - 1;
+    for (size_t i = home(inode);; i = (i + 1) & mask) {
+        const Slot& slot = m_slots[i];
+        if (slot.inode == inode) {
+            return &slot;
+        }
+        if (slot.inode == 0) {
+            return nullptr;
+        }
+    }
+}
+
+bool InodeNameIndex::insert(uint32_t inode, uint32_t parent, const char* name, size_t length) {
+    if (inode == 0 || length == 0 || length > kMaxNameLength || full() ||
+        m_names.size() + length + 1 > UINT32_MAX) {
+        return false;
+    }
+    // Keep the table at most three quarters full so probe runs stay short
+    if ((m_count + 1) * 4 > m_slots.size() * 3) {
+        grow();
+    }
+
+    const size_t mask = m_slots.size() - 1;
+    size_t i = home(inode);
+    while (m_slots[i].inode != 0) {
+        if (m_slots[i].inode == inode) {
+            return false;
+        }
+        i = (i + 1) & mask;
+    }
+
+    m_slots[i] = {inode, parent, (uint32_t)m_names.size()};
+    m_names.push_back((char)(uint8_t)length);
+    m_names.insert(m_names.end(), name, name + length);
+    ++m_count;
+    return true;
+}
+
+void InodeNameIndex::grow() {
+    std::vector<Slot> old(m_slots.size() * 2, Slot{0, 0, 0});
+    old.swap(m_slots);
+    const size_t mask = m_slots.size() - 1;
+    for (const Slot& slot : old) {
+        if (slot.inode == 0) {
+            continue;
+        }
+        size_t i = home(slot.inode);
+        while (m_slots[i].inode != 0) {
+            i = (i + 1) & mask;
+        }
+        m_slots[i] = slot;
+    }
+}
+
+bool InodeNameIndex::find(uint32_t inode, uint32_t& parent, std::string& name) const {
+    const Slot* slot = findSlot(inode);
+    if (!slot) {
+        return false;
+    }
+    parent = slot->parent;
+    const char* entry = m_names.data() + slot->nameOffset;
+    name.assign(entry + 1, (uint8_t)entry[0]);
+    return true;
+}
+
+std::string InodeNameIndex::path(uint32_t inode, uint32_t rootInode) const {
+    std::vector<const Slot*> chain;
+    while (inode != rootInode) {
+        const Slot* slot = findSlot(inode);
+        if (!slot || (int)chain.size() >= kMaxPathDepth) {
+            return std::string();
+        }
+        chain.push_back(slot);
+        inode = slot->parent;
+    }
+
+    std::string result;
+    for (auto it = chain.rbegin(); it != chain.rend(); ++it) {
+        const char* entry = m_names.data() + (*it)->nameOffset;
+        result += '/';
+        result.append(entry + 1, (uint8_t)entry[0]);
+    }
+    return result;
+}
@@ -0,0 +1,51 @@
+#ifndef INODE_NAME_INDEX_H
+#define INODE_NAME_INDEX_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Maps inode numbers to the name and parent directory of the entry that linked them.
+// Slots are 12 bytes in a linear-probing table and names are packed into one arena with
+// a length byte in front, so millions of entries cost a few tens of megabytes; once
+// maxEntries is reached further inserts are refused rather than growing without bound.
+class InodeNameIndex {
+public:
+    explicit InodeNameIndex(size_t maxEntries = kDefaultMaxEntries);
+
+    // Returns false if the inode already has a name, the name is empty or too long, or the
+    // index is full. Inode 0 is never stored.
+    bool insert(uint32_t inode, uint32_t parent, const char* name, size_t length);
+    bool contains(uint32_t inode) const { return findSlot(inode) != nullptr; }
+    bool find(uint32_t inode, uint32_t& parent, std::string& name) const;
+
+    // Joins the names from rootInode down to inode with '/', or returns an empty string if
+    // the chain of parents does not reach rootInode
+    std::string path(uint32_t inode, uint32_t rootInode) const;
+
+    size_t size() const { return m_count; }
+    bool full() const { return m_count >= m_maxEntries; }
+    size_t capacity() const { return m_maxEntries; }
+
+    static constexpr size_t kDefaultMaxEntries = 1 << 21;
+    static constexpr size_t kMaxNameLength = 255;
+
+private:
+    struct Slot {
+        uint32_t inode; // 0 marks an empty slot
+        uint32_t parent;
+        uint32_t nameOffset;
+    };
+
+    std::vector<Slot> m_slots;
+    std::vector<char> m_names;
+    size_t m_count;
+    size_t m_maxEntries;
+
+    const Slot* findSlot(uint32_t inode) const;
+    size_t home(uint32_t inode) const;
+    void grow();
+};
+
+#endif // INODE_NAME_INDEX_H
@@ -0,0 +1,205 @@
+#include "simd_scan.h"
+#include <cstring>
+
+#if defined(__aarch64__)
+#include <arm_neon.h>
+#elif defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+ByteSet::ByteSet() {
+    clear();
+}
+
+void ByteSet::add(uint8_t value) {
+    if (m_members[value]) {
+        return;
+    }
+    m_members[value] = true;
+    ++m_count;
+    buildNibbleTables();
+}
+
+void ByteSet::clear() {
+    memset(m_members, 0, sizeof(m_members));
+    m_count = 0;
+    buildNibbleTables();
+}
+
+void ByteSet::buildNibbleTables() {
+    memset(m_lowNibbles, 0, sizeof(m_lowNibbles));
+    memset(m_highNibbles, 0, sizeof(m_highNibbles));
+    m_exact = true;
+
+    // High nibbles whose members share the same low nibbles can share a bucket exactly.
+    // Past 8 distinct groups, buckets are shared and the tables only give a superset.
+    uint16_t groupLows[16];
+    size_t groups = 0;
+    for (int high = 0; high < 16; ++high) {
+        uint16_t lows = 0;
+        for (int low = 0; low < 16; ++low) {
+            if (m_members[(high << 4) | low]) {
+                lows |= (uint16_t)(1 << low);
+            }
+        }
+        if (lows == 0) {
+            continue;
+        }
+        size_t group = 0;
+        while (group < groups && groupLows[group] != lows) {
+            ++group;
+        }
+        if (group == groups) {
+            groupLows[groups++] = lows;
+        }
+        const uint8_t bucket = (uint8_t)(1 << (group % 8));
+        m_exact = m_exact && group < 8;
+        m_highNibbles[high] |= bucket;
+        for (int low = 0; low < 16; ++low) {
+            if (lows & (1 << low)) {
+                m_lowNibbles[low] |= bucket;
+            }
+        }
+    }
+}
+
+size_t ByteSet::findFirstScalar(const uint8_t* data, size_t length) const {
+    for (size_t i = 0; i < length; ++i) {
+        if (m_members[data[i]]) {
+            return i;
+        }
+    }
+    return length;
+}
+
+// The kernels return the index of the first member, or the start of the tail shorter than
+// one vector. Candidate lanes are confirmed against the member table, which only matters
+// when the nibble tables are a superset.
+
+#if defined(__aarch64__)
+
+static size_t findFirstNeon(const uint8_t* data, size_t length, const uint8_t* lowNibbles,
+                            const uint8_t* highNibbles, const bool* members) {
+    const uint8x16_t lowTable = vld1q_u8(lowNibbles);
+    const uint8x16_t highTable = vld1q_u8(highNibbles);
+    const uint8x16_t nibbleMask = vdupq_n_u8(0x0F);
+
+    size_t i = 0;
+    for (; i + 16 <= length; i += 16) {
+        uint8x16_t block = vld1q_u8(data + i);
+        uint8x16_t low = vqtbl1q_u8(lowTable, vandq_u8(block, nibbleMask));
+        uint8x16_t high = vqtbl1q_u8(highTable, vshrq_n_u8(block, 4));
+        uint8x16_t hits = vtstq_u8(low, high);
+        // Narrow each 0x00/0xFF lane to a nibble so hits can be found with ctz
+        uint64_t mask = vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(hits), 4)), 0);
+        while (mask != 0) {
+            size_t lane = (size_t)__builtin_ctzll(mask) >> 2;
+            if (members[data[i + lane]]) {
+                return i + lane;
+            }
+            mask &= ~(0xFULL << (lane * 4));
+        }
+    }
+    return i;
+}
+
+bool ByteSet::vectorized() {
+    return true;
+}
+
+#elif defined(__x86_64__)
+
+__attribute__((target("avx2")))
+static size_t findFirstAvx2(const uint8_t* data, size_t length, const uint8_t* lowNibbles,
+                            const uint8_t* highNibbles, const bool* members) {
+    const __m256i lowTable = _mm256_broadcastsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(lowNibbles)));
+    const __m256i highTable = _mm256_broadcastsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(highNibbles)));
+    const __m256i nibbleMask = _mm256_set1_epi8(0x0F);
+    const __m256i zero = _mm256_setzero_si256();
+
+    size_t i = 0;
+    for (; i + 32 <= length; i += 32) {
+        __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+        __m256i low = _mm256_shuffle_epi8(lowTable, _mm256_and_si256(block, nibbleMask));
+        __m256i high = _mm256_shuffle_epi8(highTable, _mm256_and_si256(_mm256_srli_epi16(block, 4), nibbleMask));
+        __m256i misses = _mm256_cmpeq_epi8(_mm256_and_si256(low, high), zero);
+        uint32_t mask = ~(uint32_t)_mm256_movemask_epi8(misses);
+        while (mask != 0) {
+            size_t lane = (size_t)__builtin_ctz(mask);
+            if (members[data[i + lane]]) {
+                return i + lane;
+            }
+            mask &= mask - 1;
+        }
+    }
+    return i;
+}
+
+__attribute__((target("ssse3")))
+static size_t findFirstSsse3(const uint8_t* data, size_t length, const uint8_t* lowNibbles,
+                             const uint8_t* highNibbles, const bool* members) {
+    const __m128i lowTable = _mm_loadu_si128(reinterpret_cast<const __m128i*>(lowNibbles));
+    const __m128i highTable = _mm_loadu_si128(reinterpret_cast<const __m128i*>(highNibbles));
+    const __m128i nibbleMask = _mm_set1_epi8(0x0F);
+    const __m128i zero = _mm_setzero_si128();
+
+    size_t i = 0;
+    for (; i + 16 <= length; i += 16) {
+        __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+        __m128i low = _mm_shuffle_epi8(lowTable, _mm_and_si128(block, nibbleMask));
+        __m128i high = _mm_shuffle_epi8(highTable, _mm_and_si128(_mm_srli_epi16(block, 4), nibbleMask));
+        __m128i misses = _mm_cmpeq_epi8(_mm_and_si128(low, high), zero);
+        uint32_t mask = ~(uint32_t)_mm_movemask_epi8(misses) & 0xFFFF;
+        while (mask != 0) {
+            size_t lane = (size_t)__builtin_ctz(mask);
+            if (members[data[i + lane]]) {
+                return i + lane;
+            }
+            mask &= mask - 1;
+        }
+    }
+    return i;
+}
+
+// The Android x86_64 ABI guarantees SSSE3; other hosts are checked
+static int detectVectorLevel() {
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2") ? 2 : __builtin_cpu_supports("ssse3") ? 1 : 0;
+}
+
+static const int s_vectorLevel = detectVectorLevel();
+
+bool ByteSet::vectorized() {
+    return s_vectorLevel > 0;
+}
+
+#else
+
+bool ByteSet::vectorized() {
+    return false;
+}
+
+#endif
+
+size_t ByteSet::findFirst(const uint8_t* data, size_t length) const {
+    if (m_count == 0) {
+        return length;
+    }
+
+    size_t i = 0;
+#if defined(__aarch64__)
+    i = findFirstNeon(data, length, m_lowNibbles, m_highNibbles, m_members);
+#elif defined(__x86_64__)
+    if (s_vectorLevel == 2) {
+        i = findFirstAvx2(data, length, m_lowNibbles, m_highNibbles, m_members);
+    } else if (s_vectorLevel == 1) {
+        i = findFirstSsse3(data, length, m_lowNibbles, m_highNibbles, m_members);
+    }
+#endif
+    if (i < length && m_members[data[i]]) {
+        return i;
+    }
+
+    // Tail shorter than one vector (or no vector unit on this CPU)
+    return i + findFirstScalar(data + i, length - i);
+}
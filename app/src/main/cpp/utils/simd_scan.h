@@ -0,0 +1,43 @@
+#ifndef SIMD_SCAN_H
+#define SIMD_SCAN_H
+
+#include <cstddef>
+#include <cstdint>
+
+// Set of byte values with a vectorized "find first member" kernel.
+// Used to skip over data that cannot start any signature: NEON on arm64, AVX2 (when the
+// CPU has it) or SSSE3 on x86_64, and a table scan elsewhere. Membership is tested with
+// two 16-entry nibble tables and a byte shuffle, so the cost per vector does not grow
+// with the size of the set.
+class ByteSet {
+public:
+    ByteSet();
+
+    void add(uint8_t value);
+    void clear();
+    bool contains(uint8_t value) const { return m_members[value]; }
+    size_t count() const { return m_count; }
+
+    // Returns the index of the first byte in data that is in the set, or length if none
+    size_t findFirst(const uint8_t* data, size_t length) const;
+
+    // True if findFirst runs a vector kernel on this CPU
+    static bool vectorized();
+    // True if the nibble tables describe the set exactly; otherwise vector hits are
+    // rechecked against the member table
+    bool exact() const { return m_exact; }
+
+private:
+    bool m_members[256];
+    size_t m_count;
+    // Members are grouped into up to 8 buckets by high nibble; a byte b is a candidate
+    // when m_lowNibbles[b & 15] & m_highNibbles[b >> 4] is non-zero
+    uint8_t m_lowNibbles[16];
+    uint8_t m_highNibbles[16];
+    bool m_exact;
+
+    void buildNibbleTables();
+    size_t findFirstScalar(const uint8_t* data, size_t length) const;
+};
+
+#endif // SIMD_SCAN_H
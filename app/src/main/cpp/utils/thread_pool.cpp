@@ -0,0 +1,44 @@
+#include "thread_pool.h"
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+// Phones top out at 8 cores; more threads than that only adds contention on the device queue
+static constexpr size_t kMaxThreads = 8;
+
+ThreadPool::ThreadPool(size_t threadCount)
+    : m_threadCount(threadCount == 0 ? defaultThreadCount() : threadCount) {}
+
+ThreadPool::~ThreadPool() = default;
+
+size_t ThreadPool::defaultThreadCount() {
+    size_t cores = std::thread::hardware_concurrency();
+    return std::max<size_t>(1, std::min(cores, kMaxThreads));
+}
+
+void ThreadPool::parallelFor(size_t count, const std::function<void(size_t index, size_t worker)>& task) {
+    if (count == 0) {
+        return;
+    }
+
+    std::atomic<size_t> nextIndex(0);
+    auto worker = [&](size_t workerId) {
+        for (size_t index = nextIndex.fetch_add(1); index < count; index = nextIndex.fetch_add(1)) {
+            task(index, workerId);
+        }
+    };
+
+    size_t helpers = std::min(m_threadCount, count) - 1;
+    std::vector<std::thread> threads;
+    threads.reserve(helpers);
+    for (size_t i = 0; i < helpers; ++i) {
+        threads.emplace_back(worker, i + 1);
+    }
+
+    worker(0);
+
+    for (auto& thread : threads) {
+        thread.join();
+    }
+}
@@ -0,0 +1,27 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <cstddef>
+#include <functional>
+
+// Fixed-size worker pool for data-parallel scan loops.
+// parallelFor hands out task indices dynamically so uneven work balances itself.
+// The calling thread always runs as worker 0, which makes it the natural place
+// for progress reporting and cancellation checks.
+class ThreadPool {
+public:
+    explicit ThreadPool(size_t threadCount = 0);
+    ~ThreadPool();
+
+    size_t size() const { return m_threadCount; }
+
+    // Runs task(index, worker) for every index in [0, count) and waits for completion
+    void parallelFor(size_t count, const std::function<void(size_t index, size_t worker)>& task);
+
+    static size_t defaultThreadCount();
+
+private:
+    size_t m_threadCount;
+};
+
+#endif // THREAD_POOL_H
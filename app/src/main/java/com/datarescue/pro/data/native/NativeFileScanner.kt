@@ -23,6 +23,7 @@ class NativeFileScanner {
     external fun startDeepScan(partition: String, fileTypes: IntArray): Array<NativeRecoverableFile>
     external fun startQuickScan(fileTypes: IntArray): Array<NativeRecoverableFile>
     external fun recoverFile(sourcePath: String, outputPath: String): Boolean
+    external fun loadSignatureDatabase(databasePath: String, cacheDir: String): Boolean
     external fun stopScan()
 }
 